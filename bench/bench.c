@@ -0,0 +1,259 @@
+/* Time quack on synthetic data, with no network access needed.
+
+   Each workload is written once by fqgen into the data directory and kept
+   for later runs. quack is then timed, best of a few runs, on:
+     - ingest = reading and tallying, with `--format binary` so writing the
+                report costs next to nothing
+     - render = turning the counts into the SVG report, timed as
+                `quack merge` to SVG less `quack merge` to binary, which
+                loads the same counts
+     - total  = a normal run from FASTQ to SVG
+   Rates are over the reads and uncompressed FASTQ bytes of the workload. */
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#define usage_text                                                              \
+    "Usage: bench [OPTION...]\n"                                                \
+    "Time quack on synthetic FASTQ.\n\n"                                        \
+    "  -q, --quack PATH         quack to time (default ../quack)\n"             \
+    "  -g, --fqgen PATH         generator (default ./fqgen)\n"                  \
+    "  -a, --adapters PATH      adapters for quack -a (default ../all.fa.gz)\n" \
+    "  -d, --data DIR           where workloads are kept (default data)\n"      \
+    "  -t, --threads N          quack --threads (default 1)\n"                  \
+    "  -r, --repeats N          runs of each step, the best is kept (default 3)\n" \
+    "  -s, --scale F            scale the number of reads (default 1)\n"        \
+    "  -w, --workload NAME      only run this workload\n"
+
+typedef struct {
+    const char *name;
+    uint64_t reads;
+    int paired;
+    /* fqgen options, other than the read count and outputs */
+    const char *generate[8];
+    const char *extension;
+} workload;
+
+static const workload workloads[] = {
+    {"short", 1000000, 0, {"-l", "150", "-q", "illumina", "-z", "gzip", NULL}, ".fq.gz"},
+    {"long", 10000, 0, {"-l", "lognormal:8000:0.7", "-q", "nanopore", "-a", "0", NULL}, ".fq"},
+    {"paired", 500000, 1, {"-l", "150", "-q", "illumina", "-z", "gzip", NULL}, ".fq.gz"},
+};
+#define WORKLOADS (sizeof(workloads)/sizeof(workloads[0]))
+
+static void fail(const char *message, const char *detail) {
+    fprintf(stderr, "bench: %s%s\n", message, detail);
+    exit(1);
+}
+
+static double seconds_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec*1e-9;
+}
+
+/* Run `argv` with its output in `output` and its messages dropped. Returns
+   the wall time taken; a command that fails ends the benchmark. */
+static double run(char **argv, const char *output) {
+    double start = seconds_now();
+    pid_t pid;
+    int status, fd;
+
+    pid = fork();
+    if (pid < 0)
+        fail("cannot start ", argv[0]);
+    if (pid == 0) {
+        fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0 || dup2(fd, STDOUT_FILENO) < 0)
+            _exit(127);
+        fd = open("/dev/null", O_WRONLY);
+        if (fd >= 0)
+            dup2(fd, STDERR_FILENO);
+        execv(argv[0], argv);
+        _exit(127);
+    }
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        fail("failed: ", argv[0]);
+    return seconds_now() - start;
+}
+
+/* Best time of `repeats` runs */
+static double best_of(int repeats, char **argv, const char *output) {
+    double best = 0, t;
+    int i;
+
+    for (i = 0; i < repeats; i++) {
+        t = run(argv, output);
+        if (i == 0 || t < best)
+            best = t;
+    }
+    return best;
+}
+
+/* Size of `path` once decompressed; gzread passes plain files through */
+static uint64_t uncompressed_size(const char *path) {
+    static char buffer[1 << 16];
+    gzFile in = gzopen(path, "rb");
+    uint64_t total = 0;
+    int n;
+
+    if (in == NULL)
+        fail("cannot read ", path);
+    while ((n = gzread(in, buffer, sizeof(buffer))) > 0)
+        total += n;
+    gzclose(in);
+    return total;
+}
+
+static int exists(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0;
+}
+
+static void print_rates(const char *name, const char *stage, double seconds, uint64_t reads,
+                        uint64_t bytes) {
+    if (seconds < 1e-6)
+        seconds = 1e-6;
+    printf("%-8s %-7s %9.3f %14.0f %10.1f\n", name, stage, seconds, reads/seconds,
+           bytes/seconds/1e6);
+}
+
+int main(int argc, char **argv) {
+    const char *quack = "../quack", *fqgen = "./fqgen", *adapters = "../all.fa.gz";
+    const char *dir = "data", *only = NULL;
+    char threads[16] = "1", reads[32], files[2][4096], temporary[2][4096], qbin[4096];
+    char *args[32];
+    int repeats = 3, i, w, f, n;
+    double scale = 1, ingest, render, baseline, total;
+    uint64_t count, bytes;
+
+    for (i = 1; i < argc; i += 2) {
+        const char *name = argv[i], *value = (i + 1 < argc)?argv[i+1]:NULL;
+
+        if (strcmp(name, "-h") == 0 || strcmp(name, "--help") == 0) {
+            printf("%s", usage_text);
+            return 0;
+        }
+        if (value == NULL)
+            fail("missing value for ", name);
+        if (strcmp(name, "-q") == 0 || strcmp(name, "--quack") == 0)
+            quack = value;
+        else if (strcmp(name, "-g") == 0 || strcmp(name, "--fqgen") == 0)
+            fqgen = value;
+        else if (strcmp(name, "-a") == 0 || strcmp(name, "--adapters") == 0)
+            adapters = value;
+        else if (strcmp(name, "-d") == 0 || strcmp(name, "--data") == 0)
+            dir = value;
+        else if (strcmp(name, "-t") == 0 || strcmp(name, "--threads") == 0)
+            snprintf(threads, sizeof(threads), "%d", atoi(value));
+        else if (strcmp(name, "-r") == 0 || strcmp(name, "--repeats") == 0)
+            repeats = (atoi(value) > 0)?atoi(value):1;
+        else if (strcmp(name, "-s") == 0 || strcmp(name, "--scale") == 0)
+            scale = atof(value);
+        else if (strcmp(name, "-w") == 0 || strcmp(name, "--workload") == 0)
+            only = value;
+        else
+            fail("unknown option ", name);
+    }
+    if (!(scale > 0))
+        fail("--scale must be more than 0", "");
+    mkdir(dir, 0755);
+
+    printf("%-8s %-7s %9s %14s %10s\n", "workload", "stage", "seconds", "reads/s", "MB/s");
+    for (w = 0; w < (int)WORKLOADS; w++) {
+        const workload *work = &workloads[w];
+
+        if (only != NULL && strcmp(only, work->name) != 0)
+            continue;
+        count = work->reads*scale;
+        if (count == 0)
+            count = 1;
+
+        /* Generate the files unless an earlier run left them. They are
+           named after their size, and renamed into place once complete */
+        for (f = 0; f < 1 + work->paired; f++) {
+            snprintf(files[f], sizeof(files[f]), "%s/%s-%llu%s%s", dir, work->name,
+                     (unsigned long long)count, work->paired?(f == 0?"_1":"_2"):"", work->extension);
+            snprintf(temporary[f], sizeof(temporary[f]), "%s.tmp", files[f]);
+        }
+        if (!exists(files[0]) || (work->paired && !exists(files[1]))) {
+            snprintf(reads, sizeof(reads), "%llu", (unsigned long long)count);
+            n = 0;
+            args[n++] = (char*)fqgen;
+            args[n++] = "-n";
+            args[n++] = reads;
+            for (i = 0; work->generate[i] != NULL; i++)
+                args[n++] = (char*)work->generate[i];
+            args[n++] = "-o";
+            args[n++] = temporary[0];
+            if (work->paired) {
+                args[n++] = "-O";
+                args[n++] = temporary[1];
+            }
+            args[n] = NULL;
+            fprintf(stderr, "bench: writing %s workload\n", work->name);
+            run(args, "/dev/null");
+            for (f = 0; f < 1 + work->paired; f++)
+                if (rename(temporary[f], files[f]) != 0)
+                    fail("cannot write ", files[f]);
+        }
+
+        bytes = 0;
+        for (f = 0; f < 1 + work->paired; f++)
+            bytes += uncompressed_size(files[f]);
+        snprintf(qbin, sizeof(qbin), "%s/%s-%llu.qbin", dir, work->name, (unsigned long long)count);
+
+        /* FASTQ to counts, and to the full report */
+        n = 0;
+        args[n++] = (char*)quack;
+        if (work->paired) {
+            args[n++] = "-1";
+            args[n++] = files[0];
+            args[n++] = "-2";
+            args[n++] = files[1];
+        } else {
+            args[n++] = "-u";
+            args[n++] = files[0];
+        }
+        args[n++] = "-a";
+        args[n++] = (char*)adapters;
+        args[n++] = "-t";
+        args[n++] = threads;
+        args[n] = NULL;
+        total = best_of(repeats, args, "/dev/null");
+        args[n++] = "-f";
+        args[n++] = "binary";
+        args[n] = NULL;
+        ingest = best_of(repeats, args, qbin);
+
+        /* Counts to the report */
+        n = 0;
+        args[n++] = (char*)quack;
+        args[n++] = "merge";
+        args[n++] = "-f";
+        args[n++] = "binary";
+        args[n++] = qbin;
+        args[n] = NULL;
+        baseline = best_of(repeats, args, "/dev/null");
+        args[3] = "svg";
+        render = best_of(repeats, args, "/dev/null") - baseline;
+        if (render < 0)
+            render = 0;
+
+        count *= 1 + work->paired;
+        print_rates(work->name, "ingest", ingest, count, bytes);
+        print_rates(work->name, "render", render, count, bytes);
+        print_rates(work->name, "total", total, count, bytes);
+        fflush(stdout);
+    }
+
+    return 0;
+}
@@ -0,0 +1,425 @@
+/* Synthetic FASTQ for benchmarking quack without downloading anything.
+
+   Reads are random sequence of a set GC content, with a length drawn from a
+   fixed, uniform or log-normal distribution and qualities from a simple
+   model of a short or long read instrument. A fraction of reads (fragments,
+   when paired) are shorter than the read, so the read runs on into the
+   adapter. Output is plain, gzip or BGZF. Every run with the same options
+   writes the same bytes. */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#define usage_text                                                              \
+    "Usage: fqgen [OPTION...]\n"                                                \
+    "Write synthetic FASTQ.\n\n"                                                \
+    "  -n, --reads N            reads (pairs, with -O) to write (default 100000)\n" \
+    "  -l, --length DIST        read length: N, MIN:MAX (uniform) or\n"         \
+    "                           lognormal:MEAN:SIGMA (default 150)\n"           \
+    "  -q, --quality MODEL      illumina (default), nanopore or flat:Q\n"       \
+    "  -g, --gc F               GC content, 0 to 1 (default 0.5)\n"             \
+    "  -a, --adapter-rate F     fraction of reads running into the adapter\n"   \
+    "                           (default 0.05)\n"                               \
+    "  -A, --adapter SEQ        adapter sequence (default TruSeq)\n"            \
+    "  -z, --compress TYPE      none (default), gzip or bgzf\n"                 \
+    "  -o, --output FILE        output, - for standard output (default -)\n"    \
+    "  -O, --output2 FILE       write pairs, the second mates to FILE\n"        \
+    "  -s, --seed N             random seed (default 1)\n"
+
+/* Adapters read into by each mate of a short fragment, as in all.fa.gz */
+#define ADAPTER_1 "AGATCGGAAGAGCACACGTCTGAACTCCAGTCAC"
+#define ADAPTER_2 "AGATCGGAAGAGCGTCGTGTAGGGAAAGAGTGTAGATCTCGGTGGTCGCCGTATCATT"
+
+/* BGZF blocks hold at most 64 KB; bgzip fills them to this */
+#define BGZF_BLOCK 65280
+
+enum { LENGTH_FIXED, LENGTH_UNIFORM, LENGTH_LOGNORMAL };
+enum { QUALITY_ILLUMINA, QUALITY_NANOPORE, QUALITY_FLAT };
+enum { COMPRESS_NONE, COMPRESS_GZIP, COMPRESS_BGZF };
+
+typedef struct {
+    uint64_t reads, seed;
+    int length_type;
+    double length_a, length_b;
+    int quality_type, quality_flat;
+    double gc, adapter_rate;
+    /* Adapter of each mate; -A sets both */
+    const char *adapter[2];
+    int compress;
+    const char *output, *output2;
+} options;
+
+static void fail(const char *message, const char *detail) {
+    fprintf(stderr, "fqgen: %s%s\n", message, detail);
+    exit(1);
+}
+
+
+/*************** Random numbers ***************/
+
+/* splitmix64, small and good enough for test data */
+static uint64_t next_random(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30))*0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27))*0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/* Uniform in [0, 1) */
+static double uniform(uint64_t *state) {
+    return (next_random(state) >> 11)*0x1.0p-53;
+}
+
+/* Standard normal, by Box-Muller */
+static double normal(uint64_t *state) {
+    double u = uniform(state), v = uniform(state);
+    return sqrt(-2*log(1 - u))*cos(2*3.14159265358979323846*v);
+}
+
+
+/*************** Output ***************/
+
+/* One output file, compressed as asked */
+typedef struct {
+    int compress;
+    FILE *file;
+    gzFile gz;
+    z_stream zs;
+    unsigned char *block, *deflated;
+    size_t used;
+} writer;
+
+static void writer_open(writer *out, const char *path, int compress) {
+    memset(out, 0, sizeof(writer));
+    out->compress = compress;
+    out->file = (strcmp(path, "-") == 0)?stdout:fopen(path, "wb");
+    if (out->file == NULL)
+        fail("cannot write ", path);
+
+    if (compress == COMPRESS_GZIP) {
+        out->gz = gzdopen(dup(fileno(out->file)), "wb6");
+        if (out->gz == NULL)
+            fail("cannot write ", path);
+    } else if (compress == COMPRESS_BGZF) {
+        out->block = malloc(BGZF_BLOCK);
+        out->deflated = malloc(2*BGZF_BLOCK);
+        deflateInit2(&out->zs, 6, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+    }
+}
+
+static void put16(unsigned char *p, uint32_t x) {
+    p[0] = x;
+    p[1] = x >> 8;
+}
+
+static void put32(unsigned char *p, uint32_t x) {
+    put16(p, x);
+    put16(p + 2, x >> 16);
+}
+
+/* Write the buffered bytes as one BGZF block: a gzip member whose 'BC' extra
+   field gives its compressed size */
+static void bgzf_block(writer *out) {
+    unsigned char header[18] = {0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0};
+    unsigned char trailer[8];
+    size_t size;
+
+    deflateReset(&out->zs);
+    out->zs.next_in = out->block;
+    out->zs.avail_in = out->used;
+    out->zs.next_out = out->deflated;
+    out->zs.avail_out = 2*BGZF_BLOCK;
+    if (deflate(&out->zs, Z_FINISH) != Z_STREAM_END)
+        fail("cannot compress", "");
+    size = 2*BGZF_BLOCK - out->zs.avail_out;
+
+    put16(header + 16, sizeof(header) + size + sizeof(trailer) - 1);
+    put32(trailer, crc32(0, out->block, out->used));
+    put32(trailer + 4, out->used);
+    fwrite(header, 1, sizeof(header), out->file);
+    fwrite(out->deflated, 1, size, out->file);
+    fwrite(trailer, 1, sizeof(trailer), out->file);
+    out->used = 0;
+}
+
+static void writer_write(writer *out, const char *data, size_t length) {
+    size_t n;
+
+    if (out->compress == COMPRESS_NONE) {
+        fwrite(data, 1, length, out->file);
+    } else if (out->compress == COMPRESS_GZIP) {
+        gzwrite(out->gz, data, length);
+    } else {
+        while (length > 0) {
+            n = (length < BGZF_BLOCK - out->used)?length:BGZF_BLOCK - out->used;
+            memcpy(out->block + out->used, data, n);
+            out->used += n;
+            data += n;
+            length -= n;
+            if (out->used == BGZF_BLOCK)
+                bgzf_block(out);
+        }
+    }
+}
+
+static void writer_close(writer *out) {
+    if (out->compress == COMPRESS_GZIP) {
+        if (gzclose(out->gz) != Z_OK)
+            fail("cannot finish writing", "");
+    } else if (out->compress == COMPRESS_BGZF) {
+        if (out->used > 0)
+            bgzf_block(out);
+        /* An empty block marks the end of a BGZF file */
+        bgzf_block(out);
+        deflateEnd(&out->zs);
+        free(out->block);
+        free(out->deflated);
+    }
+    if (fflush(out->file) != 0 || ferror(out->file))
+        fail("cannot finish writing", "");
+    if (out->file != stdout)
+        fclose(out->file);
+}
+
+
+/*************** Reads ***************/
+
+static uint64_t read_length(const options *opt, uint64_t *state) {
+    double length;
+
+    switch (opt->length_type) {
+    case LENGTH_UNIFORM:
+        return opt->length_a + (uint64_t)(uniform(state)*(opt->length_b - opt->length_a + 1));
+    case LENGTH_LOGNORMAL:
+        /* `length_a` is the mean, so the median is a little lower */
+        length = exp(log(opt->length_a) - opt->length_b*opt->length_b/2 + opt->length_b*normal(state));
+        return (length < 1)?1:(uint64_t)length;
+    default:
+        return opt->length_a;
+    }
+}
+
+/* Qualities as Phred+33. Short reads start high and fall off towards the
+   end; long reads get a mean per read, and vary a lot around it. */
+static void fill_quality(const options *opt, uint64_t *state, char *qual, uint64_t length) {
+    double mean, q;
+    uint64_t i;
+
+    if (opt->quality_type == QUALITY_FLAT) {
+        memset(qual, 33 + opt->quality_flat, length);
+        return;
+    }
+
+    mean = 8 + 8*uniform(state);
+    for (i = 0; i < length; i++) {
+        if (opt->quality_type == QUALITY_ILLUMINA) {
+            double along = (double)i/length;
+            q = 37 - 12*along*along + 2*normal(state);
+            if (q > 41) q = 41;
+        } else {
+            q = mean + 4*normal(state);
+            if (q > 50) q = 50;
+        }
+        if (q < 2) q = 2;
+        qual[i] = 33 + (int)q;
+    }
+}
+
+static void fill_bases(const options *opt, uint64_t *state, char *seq, uint64_t length) {
+    uint64_t i;
+    double r;
+
+    for (i = 0; i < length; i++) {
+        r = uniform(state);
+        if (r < opt->gc)
+            seq[i] = (r < opt->gc/2)?'G':'C';
+        else
+            seq[i] = (r < opt->gc + (1 - opt->gc)/2)?'A':'T';
+    }
+}
+
+static char complement(char base) {
+    switch (base) {
+    case 'A': return 'T';
+    case 'C': return 'G';
+    case 'G': return 'C';
+    case 'T': return 'A';
+    default:  return 'N';
+    }
+}
+
+/* Bases of one mate read off `fragment`, `insert` long, into `seq`. A
+   fragment shorter than the read is followed by the adapter and then random
+   bases. */
+static void read_mate(const options *opt, uint64_t *state, const char *fragment, uint64_t insert,
+                      int reverse, const char *adapter, char *seq, uint64_t length) {
+    uint64_t i, n = (insert < length)?insert:length, adapter_length = strlen(adapter);
+
+    for (i = 0; i < n; i++)
+        seq[i] = reverse?complement(fragment[insert - 1 - i]):fragment[i];
+    for (i = n; i < length && i - n < adapter_length; i++)
+        seq[i] = adapter[i - n];
+    if (i < length)
+        fill_bases(opt, state, seq + i, length - i);
+}
+
+/* Format one record into `buffer` and return its length */
+static size_t format_record(char *buffer, uint64_t number, int mate, const char *seq,
+                            const char *qual, uint64_t length) {
+    size_t n;
+
+    n = (mate > 0)?sprintf(buffer, "@fqgen.%llu/%d\n", (unsigned long long)number, mate)
+                  :sprintf(buffer, "@fqgen.%llu\n", (unsigned long long)number);
+    memcpy(buffer + n, seq, length);
+    n += length;
+    memcpy(buffer + n, "\n+\n", 3);
+    n += 3;
+    memcpy(buffer + n, qual, length);
+    n += length;
+    buffer[n++] = '\n';
+    return n;
+}
+
+
+/*************** Options ***************/
+
+static double parse_double(const char *s, const char *what) {
+    char *end;
+    double value = strtod(s, &end);
+    if (end == s || *end != '\0')
+        fail("bad number for ", what);
+    return value;
+}
+
+static void parse_length(options *opt, const char *s) {
+    if (strncmp(s, "lognormal:", 10) == 0) {
+        opt->length_type = LENGTH_LOGNORMAL;
+        if (sscanf(s + 10, "%lf:%lf", &opt->length_a, &opt->length_b) != 2 ||
+            opt->length_a < 1 || opt->length_b < 0)
+            fail("bad --length ", s);
+    } else if (strchr(s, ':') != NULL) {
+        opt->length_type = LENGTH_UNIFORM;
+        if (sscanf(s, "%lf:%lf", &opt->length_a, &opt->length_b) != 2 ||
+            opt->length_a < 1 || opt->length_b < opt->length_a)
+            fail("bad --length ", s);
+    } else {
+        opt->length_type = LENGTH_FIXED;
+        opt->length_a = parse_double(s, "--length");
+        if (opt->length_a < 1)
+            fail("bad --length ", s);
+    }
+}
+
+static void parse_options(options *opt, int argc, char **argv) {
+    int i;
+
+    *opt = (options){100000, 1, LENGTH_FIXED, 150, 0, QUALITY_ILLUMINA, 0, 0.5, 0.05,
+                     {ADAPTER_1, ADAPTER_2}, COMPRESS_NONE, "-", NULL};
+
+    for (i = 1; i < argc; i += 2) {
+        const char *name = argv[i], *value = (i + 1 < argc)?argv[i+1]:NULL;
+
+        if (strcmp(name, "-h") == 0 || strcmp(name, "--help") == 0) {
+            printf("%s", usage_text);
+            exit(0);
+        }
+        if (value == NULL)
+            fail("missing value for ", name);
+
+        if (strcmp(name, "-n") == 0 || strcmp(name, "--reads") == 0) {
+            opt->reads = strtoull(value, NULL, 10);
+        } else if (strcmp(name, "-l") == 0 || strcmp(name, "--length") == 0) {
+            parse_length(opt, value);
+        } else if (strcmp(name, "-q") == 0 || strcmp(name, "--quality") == 0) {
+            if (strcmp(value, "illumina") == 0)
+                opt->quality_type = QUALITY_ILLUMINA;
+            else if (strcmp(value, "nanopore") == 0)
+                opt->quality_type = QUALITY_NANOPORE;
+            else if (strncmp(value, "flat:", 5) == 0 && atoi(value + 5) >= 0 && atoi(value + 5) <= 90)
+                opt->quality_type = QUALITY_FLAT, opt->quality_flat = atoi(value + 5);
+            else
+                fail("--quality must be illumina, nanopore or flat:Q, not ", value);
+        } else if (strcmp(name, "-g") == 0 || strcmp(name, "--gc") == 0) {
+            opt->gc = parse_double(value, name);
+            if (opt->gc < 0 || opt->gc > 1)
+                fail("--gc must be 0 to 1", "");
+        } else if (strcmp(name, "-a") == 0 || strcmp(name, "--adapter-rate") == 0) {
+            opt->adapter_rate = parse_double(value, name);
+            if (opt->adapter_rate < 0 || opt->adapter_rate > 1)
+                fail("--adapter-rate must be 0 to 1", "");
+        } else if (strcmp(name, "-A") == 0 || strcmp(name, "--adapter") == 0) {
+            opt->adapter[0] = opt->adapter[1] = value;
+        } else if (strcmp(name, "-z") == 0 || strcmp(name, "--compress") == 0) {
+            if (strcmp(value, "none") == 0)
+                opt->compress = COMPRESS_NONE;
+            else if (strcmp(value, "gzip") == 0)
+                opt->compress = COMPRESS_GZIP;
+            else if (strcmp(value, "bgzf") == 0)
+                opt->compress = COMPRESS_BGZF;
+            else
+                fail("--compress must be none, gzip or bgzf, not ", value);
+        } else if (strcmp(name, "-o") == 0 || strcmp(name, "--output") == 0) {
+            opt->output = value;
+        } else if (strcmp(name, "-O") == 0 || strcmp(name, "--output2") == 0) {
+            opt->output2 = value;
+        } else if (strcmp(name, "-s") == 0 || strcmp(name, "--seed") == 0) {
+            opt->seed = strtoull(value, NULL, 10);
+        } else {
+            fail("unknown option ", name);
+        }
+    }
+}
+
+
+int main(int argc, char **argv) {
+    options opt;
+    writer out[2];
+    uint64_t state, r, length, insert, capacity = 0;
+    char *fragment = NULL, *seq = NULL, *qual = NULL, *buffer = NULL;
+    int paired, mate;
+    size_t n;
+
+    parse_options(&opt, argc, argv);
+    paired = (opt.output2 != NULL);
+    writer_open(&out[0], opt.output, opt.compress);
+    if (paired)
+        writer_open(&out[1], opt.output2, opt.compress);
+
+    state = opt.seed;
+    for (r = 0; r < opt.reads; r++) {
+        length = read_length(&opt, &state);
+        if (length > capacity) {
+            capacity = 2*length;
+            fragment = realloc(fragment, capacity);
+            seq = realloc(seq, capacity);
+            qual = realloc(qual, capacity);
+            buffer = realloc(buffer, 2*capacity + 64);
+        }
+
+        /* Most fragments are longer than the read; short ones run into the
+           adapter */
+        insert = (uniform(&state) < opt.adapter_rate)?(uint64_t)(uniform(&state)*length):length;
+        fill_bases(&opt, &state, fragment, insert);
+
+        for (mate = 0; mate < 1 + paired; mate++) {
+            read_mate(&opt, &state, fragment, insert, mate, opt.adapter[mate], seq, length);
+            fill_quality(&opt, &state, qual, length);
+            n = format_record(buffer, r + 1, paired?mate + 1:0, seq, qual, length);
+            writer_write(&out[mate], buffer, n);
+        }
+    }
+
+    writer_close(&out[0]);
+    if (paired)
+        writer_close(&out[1]);
+    free(fragment);
+    free(seq);
+    free(qual);
+    free(buffer);
+    return 0;
+}
@@ -0,0 +1,142 @@
+#include "checkpoint.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static void fail(const char *path, const char *message) {
+    fprintf(stderr, "quack: %s: %s\n", path, message);
+    exit(1);
+}
+
+static uint64_t padded(uint64_t length) {
+    return (length + 7) & ~(uint64_t)7;
+}
+
+static void write_padded(FILE *out, const void *data, uint64_t length) {
+    static const char zeros[8] = {0};
+
+    fwrite(data, 1, length, out);
+    fwrite(zeros, 1, padded(length) - length, out);
+}
+
+void checkpoint_write(const char *path, sequence_data **data, const stats_info *info,
+                      char **files, const checkpoint_position *positions,
+                      const checkpoint_settings *settings) {
+    char temporary[PATH_MAX];
+    checkpoint_trailer trailer = {settings->skip, settings->max_reads, settings->seed,
+                                  settings->fraction, 0, CHECKPOINT_MAGIC,
+                                  CHECKPOINT_VERSION, STATS_BYTE_ORDER};
+    FILE *out;
+    int i;
+
+    /* Written aside and renamed over the old one, so a run stopped at any
+       moment leaves a whole checkpoint */
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+    out = fopen(temporary, "w");
+    if (out == NULL)
+        fail(temporary, "cannot write checkpoint");
+    stats_write(out, data, info);
+
+    for (i = 0; i < info->sections; i++) {
+        const checkpoint_position *position = &positions[i];
+        checkpoint_section section = {position->offset, position->index, position->kept,
+                                      position->done, position->point.offset,
+                                      position->point.compressed, position->point.bits,
+                                      position->point.window_length, strlen(files[i]) + 1};
+
+        fwrite(&section, sizeof(section), 1, out);
+        write_padded(out, files[i], section.name_length);
+        write_padded(out, position->point.window, section.window_length);
+        trailer.length += sizeof(section) + padded(section.name_length) + padded(section.window_length);
+    }
+    fwrite(&trailer, sizeof(trailer), 1, out);
+
+    if (fflush(out) != 0 || ferror(out) || fsync(fileno(out)) != 0)
+        fail(temporary, "cannot write checkpoint");
+    fclose(out);
+    if (rename(temporary, path) != 0)
+        fail(path, "cannot write checkpoint");
+}
+
+int checkpoint_read(const char *path, sequence_data **data, const stats_info *info,
+                    int adapters, char **names, char **files, checkpoint_position *positions,
+                    const checkpoint_settings *settings) {
+    int fd, i;
+    struct stat st;
+    const char *map, *at, *end;
+    const checkpoint_trailer *trailer;
+    const checkpoint_section *section;
+    stats_info saved;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0 && errno == ENOENT)
+        return 0;
+    if (fd < 0 || fstat(fd, &st) != 0)
+        fail(path, "cannot open");
+    if ((size_t)st.st_size < sizeof(checkpoint_trailer))
+        fail(path, "not a quack checkpoint");
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        fail(path, "cannot map");
+    end = map + st.st_size - sizeof(checkpoint_trailer);
+
+    trailer = (const checkpoint_trailer*)end;
+    if (memcmp(trailer->magic, CHECKPOINT_MAGIC, 8) != 0)
+        fail(path, "not a quack checkpoint");
+    if (trailer->version != CHECKPOINT_VERSION)
+        fail(path, "written by an incompatible version of quack");
+    if (trailer->byte_order != STATS_BYTE_ORDER)
+        fail(path, "written on a machine with a different byte order");
+    if (trailer->length > (uint64_t)(end - map))
+        fail(path, "corrupt checkpoint");
+
+    /* The counts are a stats file, checked the same way as for merging */
+    stats_merge(path, data, &saved);
+    if (saved.sections != info->sections || saved.adapters_used != info->adapters_used ||
+        saved.kmer_size != info->kmer_size || data[0]->adapters != adapters)
+        fail(path, "checkpoint made with different settings");
+    for (i = 0; i < adapters; i++)
+        if (strcmp(data[0]->adapter_names[i], names[i]) != 0)
+            fail(path, "checkpoint made with different adapters");
+    if (trailer->skip != settings->skip || trailer->max_reads != settings->max_reads ||
+        trailer->seed != settings->seed || trailer->fraction != settings->fraction)
+        fail(path, "checkpoint made with different sampling");
+
+    at = end - trailer->length;
+    for (i = 0; i < info->sections; i++) {
+        checkpoint_position *position = &positions[i];
+
+        section = (const checkpoint_section*)at;
+        if ((uint64_t)(end - at) < sizeof(checkpoint_section))
+            fail(path, "corrupt checkpoint");
+        at += sizeof(checkpoint_section);
+        if (section->window_length > INPUT_WINDOW || section->name_length == 0 ||
+            padded(section->name_length) + padded(section->window_length) > (uint64_t)(end - at) ||
+            at[section->name_length - 1] != '\0')
+            fail(path, "corrupt checkpoint");
+        if (strcmp(at, files[i]) != 0)
+            fail(path, "checkpoint made for other files");
+        at += padded(section->name_length);
+
+        position->offset = section->offset;
+        position->index = section->index;
+        position->kept = section->kept;
+        position->done = section->done;
+        position->point.offset = section->point_offset;
+        position->point.compressed = section->point_compressed;
+        position->point.bits = section->point_bits;
+        position->point.window_length = section->window_length;
+        memcpy(position->point.window, at, section->window_length);
+        at += padded(section->window_length);
+    }
+
+    munmap((void*)map, st.st_size);
+    return 1;
+}
@@ -0,0 +1,70 @@
+#ifndef __CHECKPOINT_H
+#define __CHECKPOINT_H
+
+#include <stdint.h>
+
+#include "reader.h"
+#include "stats.h"
+
+/* How far reading one file has got. The next record starts at uncompressed
+   byte `offset`, which is reached by restarting the stream at `point`. */
+typedef struct {
+    input_point point;
+    uint64_t offset;
+    /* Records read, and kept by the sampling, before it */
+    uint64_t index, kept;
+    /* The whole file has been read */
+    int done;
+} checkpoint_position;
+
+/* Sampling a checkpoint was made with, which a resumed run must share */
+typedef struct {
+    uint64_t skip, max_reads, seed;
+    double fraction;
+} checkpoint_settings;
+
+/* Checkpoint kept by `--checkpoint`, so a run that was stopped can carry on
+   where it got to instead of starting over.
+
+   It is a stats file (see stats.h) of the counts so far, which `quack merge`
+   can read as it is, followed by:
+     - for each section:
+         checkpoint_section
+         `name_length` bytes of NUL terminated file name, zero padded
+         `window_length` bytes of inflate window, zero padded
+     - checkpoint_trailer, `length` bytes after the end of the stats file
+ */
+#define CHECKPOINT_MAGIC "QUACKCKP"
+#define CHECKPOINT_VERSION 1
+
+typedef struct {
+    uint64_t offset, index, kept, done;
+    uint64_t point_offset, point_compressed;
+    uint32_t point_bits, window_length;
+    uint64_t name_length;
+} checkpoint_section;
+
+typedef struct {
+    uint64_t skip, max_reads, seed;
+    double fraction;
+    uint64_t length;
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+} checkpoint_trailer;
+
+/* Replace `path` with a checkpoint of `info->sections` files named `files`,
+   holding `data` and read up to `positions` */
+void checkpoint_write(const char *path, sequence_data **data, const stats_info *info,
+                      char **files, const checkpoint_position *positions,
+                      const checkpoint_settings *settings);
+
+/* Load the checkpoint `path` into `data`, which must hold `info->sections`
+   NULL entries, and `positions`. Returns 0 if there is no such file. A
+   checkpoint of other files, or made with other adapters (`adapters` named
+   `names`), k-mer size or sampling, ends the program. */
+int checkpoint_read(const char *path, sequence_data **data, const stats_info *info,
+                    int adapters, char **names, char **files, checkpoint_position *positions,
+                    const checkpoint_settings *settings);
+
+#endif
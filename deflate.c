@@ -0,0 +1,579 @@
+#include "deflate.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define likely(x)   __builtin_expect ((x), 1)
+#define unlikely(x) __builtin_expect ((x), 0)
+
+/* Huffman decoding tables, indexed by the next bits of input. An entry holds
+   a symbol in its low 16 bits and the length of its code in bits 16-20; an
+   entry of 0 is not a code. Codes longer than the table's `bits` go through
+   a subtable of 15 - `bits` more bits: the entry has SUBTABLE set and the
+   subtable's first entry in its low 16 bits. There are at most as many
+   subtables as symbols. */
+#define SUBTABLE     0x80000000u
+#define MAX_BITS     15
+#define LITLEN_BITS  10
+#define DIST_BITS    8
+#define CODES_BITS   7
+#define LITLEN_TABLE ((1 << LITLEN_BITS) + 288*(1 << (MAX_BITS - LITLEN_BITS)))
+#define DIST_TABLE   ((1 << DIST_BITS) + 32*(1 << (MAX_BITS - DIST_BITS)))
+
+/* Deflate compresses at most 1032 to 1, so a part decoding to more than this
+   much per byte of input is not deflate */
+#define MAX_RATIO 1032
+
+static const uint16_t length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const unsigned char length_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t dist_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const unsigned char dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+/* Order the code length code lengths are sent in */
+static const unsigned char code_order[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+/* Input read a bit at a time, lowest bit of each byte first. Reading past
+   the end gives zeros, and a position past `size` bytes. */
+typedef struct {
+    const unsigned char *data;
+    size_t size, next;
+    uint64_t buffer;
+    unsigned count;
+} bit_reader;
+
+/* Decoder state. With `markers`, references from before the first symbol
+   are to the unknown window; otherwise nothing before `floor`, the start of
+   the member, can be referred to. */
+typedef struct {
+    bit_reader in;
+    deflate_part *part;
+    size_t floor, limit;
+    int markers;
+    uint32_t litlen[LITLEN_TABLE], dist[DIST_TABLE];
+    uint32_t fixed_litlen[LITLEN_TABLE], fixed_dist[DIST_TABLE];
+    int fixed_built;
+} decoder;
+
+static uint64_t load64le(const unsigned char *p) {
+    return (uint64_t)p[0] | (uint64_t)p[1] << 8 | (uint64_t)p[2] << 16 | (uint64_t)p[3] << 24 |
+        (uint64_t)p[4] << 32 | (uint64_t)p[5] << 40 | (uint64_t)p[6] << 48 | (uint64_t)p[7] << 56;
+}
+
+static uint32_t le32(const unsigned char *p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void seek(bit_reader *in, uint64_t bit) {
+    in->next = bit >> 3;
+    in->buffer = 0;
+    in->count = 0;
+    if (in->next < in->size) {
+        in->buffer = in->data[in->next++] >> (bit & 7);
+        in->count = 8 - (bit & 7);
+    } else {
+        in->next++;
+        in->count = 8 - (bit & 7);
+    }
+}
+
+static uint64_t position(const bit_reader *in) {
+    return (uint64_t)in->next*8 - in->count;
+}
+
+/* Make sure at least 56 bits are buffered */
+static inline void refill(bit_reader *in) {
+    if (likely(in->next + 8 <= in->size)) {
+        in->buffer |= load64le(in->data + in->next) << in->count;
+        in->next += (63 - in->count) >> 3;
+        in->count |= 56;
+        return;
+    }
+    while (in->count <= 56) {
+        if (in->next < in->size)
+            in->buffer |= (uint64_t)in->data[in->next] << in->count;
+        in->next++;
+        in->count += 8;
+    }
+}
+
+static inline uint32_t take(bit_reader *in, unsigned n) {
+    uint32_t value = in->buffer & ((1ULL << n) - 1);
+    in->buffer >>= n;
+    in->count -= n;
+    return value;
+}
+
+static inline int overrun(const bit_reader *in) {
+    return position(in) > (uint64_t)in->size*8;
+}
+
+static unsigned reverse(unsigned code, int length) {
+    unsigned reversed = 0;
+    while (length-- > 0) {
+        reversed = reversed << 1 | (code & 1);
+        code >>= 1;
+    }
+    return reversed;
+}
+
+/* Build the table for the code with `lengths` for `n` symbols. Returns 0 if
+   the lengths don't make a prefix code. As in zlib, a code may only be
+   incomplete if it is a single code of one bit, and distance codes
+   (`distances`) may have no codes at all. */
+static int build(uint32_t *table, int bits, const unsigned char *lengths, int n, int distances) {
+    int count[MAX_BITS + 1] = {0}, offset[MAX_BITS + 2];
+    uint16_t sorted[288];
+    int i, length, left, max = 0, sub_bits = MAX_BITS - bits;
+    unsigned code, low, high, k, next_sub = 1u << bits;
+
+    for (i = 0; i < n; i++)
+        count[lengths[i]]++;
+    count[0] = 0;
+    for (length = MAX_BITS; length > 0 && max == 0; length--)
+        if (count[length] > 0)
+            max = length;
+    memset(table, 0, sizeof(uint32_t) << bits);
+    if (max == 0)
+        return distances;
+
+    left = 1;
+    for (length = 1; length <= MAX_BITS; length++) {
+        left = 2*left - count[length];
+        if (left < 0)
+            return 0;
+    }
+    if (left > 0 && max != 1)
+        return 0;
+
+    offset[1] = 0;
+    for (length = 1; length <= MAX_BITS; length++)
+        offset[length + 1] = offset[length] + count[length];
+    for (i = 0; i < n; i++)
+        if (lengths[i] != 0)
+            sorted[offset[lengths[i]]++] = i;
+
+    /* Canonical codes, in order of length then symbol */
+    code = 0;
+    i = 0;
+    for (length = 1; length <= max; length++, code <<= 1) {
+        for (k = 0; k < (unsigned)count[length]; k++, code++, i++) {
+            uint32_t entry = sorted[i] | (uint32_t)length << 16;
+            unsigned reversed = reverse(code, length);
+
+            if (length <= bits) {
+                for (low = reversed; low < 1u << bits; low += 1u << length)
+                    table[low] = entry;
+                continue;
+            }
+            low = reversed & ((1u << bits) - 1);
+            if (!(table[low] & SUBTABLE)) {
+                table[low] = SUBTABLE | next_sub;
+                memset(table + next_sub, 0, sizeof(uint32_t) << sub_bits);
+                next_sub += 1u << sub_bits;
+            }
+            for (high = reversed >> bits; high < 1u << sub_bits; high += 1u << (length - bits))
+                table[(table[low] & 0xffff) + high] = entry;
+        }
+    }
+    return 1;
+}
+
+/* Decode one symbol, with at least 15 bits buffered. Returns 0 for a bit
+   pattern that isn't a code. */
+static inline uint32_t decode(bit_reader *in, const uint32_t *table, int bits) {
+    uint32_t entry = table[in->buffer & ((1u << bits) - 1)];
+
+    if (entry & SUBTABLE)
+        entry = table[(entry & 0xffff) + ((in->buffer >> bits) & ((1u << (MAX_BITS - bits)) - 1))];
+    if (entry != 0) {
+        in->buffer >>= entry >> 16;
+        in->count -= entry >> 16;
+    }
+    return entry;
+}
+
+static inline int is_text(unsigned byte) {
+    return (byte >= 32 && byte < 127) || byte == '\n' || byte == '\r' || byte == '\t';
+}
+
+/* Room for `more` symbols */
+static int reserve(decoder *d, size_t more) {
+    deflate_part *part = d->part;
+    size_t capacity;
+
+    if (likely(part->length + more <= part->capacity))
+        return 1;
+    if (part->length + more > d->limit)
+        return 0;
+    capacity = (part->capacity > 0)?2*part->capacity:(1 << 20);
+    while (capacity < part->length + more)
+        capacity *= 2;
+    part->symbols = realloc(part->symbols, capacity*sizeof(uint16_t));
+    part->capacity = capacity;
+    return part->symbols != NULL;
+}
+
+/* Decode the symbols of a Huffman coded block up to its end. With `text`,
+   only text characters may be literals. */
+static int inflate_codes(decoder *d, const uint32_t *litlen, const uint32_t *dist, int text) {
+    bit_reader *in = &d->in;
+    deflate_part *part = d->part;
+    uint32_t entry, symbol, length, distance;
+    size_t n, i, available;
+    uint16_t *out;
+
+    for (;;) {
+        if (unlikely(!reserve(d, 258)))
+            return 0;
+        out = part->symbols;
+        n = part->length;
+        refill(in);
+        if (unlikely(in->next > in->size + 8))
+            return 0;
+
+        entry = decode(in, litlen, LITLEN_BITS);
+        if (unlikely(entry == 0))
+            return 0;
+        symbol = entry & 0xffff;
+        if (symbol < 256) {
+            if (text && !is_text(symbol))
+                return 0;
+            out[n] = symbol;
+            part->length = n + 1;
+            continue;
+        }
+        if (symbol == 256)
+            return 1;
+        symbol -= 257;
+        if (unlikely(symbol >= 29))
+            return 0;
+        length = length_base[symbol] + take(in, length_extra[symbol]);
+
+        entry = decode(in, dist, DIST_BITS);
+        if (unlikely(entry == 0))
+            return 0;
+        symbol = entry & 0xffff;
+        if (unlikely(symbol >= 30))
+            return 0;
+        refill(in);
+        distance = dist_base[symbol] + take(in, dist_extra[symbol]);
+
+        available = n - d->floor;
+        if (likely(distance <= available)) {
+            const uint16_t *from = out + n - distance;
+            if (distance >= length) {
+                memcpy(out + n, from, length*sizeof(uint16_t));
+            } else {
+                for (i = 0; i < length; i++)
+                    out[n + i] = from[i];
+            }
+        } else {
+            /* Before the start: the window, if it isn't known */
+            if (!d->markers)
+                return 0;
+            for (i = 0; i < length; i++) {
+                int64_t at = (int64_t)n + i - distance;
+                out[n + i] = (at < 0)?(uint16_t)(0x10000 + at):out[at];
+            }
+        }
+        part->length = n + length;
+    }
+}
+
+static int inflate_stored(decoder *d, int text) {
+    bit_reader *in = &d->in;
+    deflate_part *part = d->part;
+    uint64_t at;
+    uint32_t length, check;
+    size_t i;
+
+    take(in, in->count & 7);
+    refill(in);
+    length = take(in, 16);
+    check = take(in, 16);
+    if (length != (~check & 0xffff))
+        return 0;
+    at = position(in) >> 3;
+    if (at + length > in->size || !reserve(d, length))
+        return 0;
+    for (i = 0; i < length; i++) {
+        if (text && !is_text(in->data[at + i]))
+            return 0;
+        part->symbols[part->length + i] = in->data[at + i];
+    }
+    part->length += length;
+    seek(in, (at + length)*8);
+    return 1;
+}
+
+static void build_fixed(decoder *d) {
+    unsigned char lengths[288];
+    int i;
+
+    for (i = 0; i < 144; i++) lengths[i] = 8;
+    for (; i < 256; i++) lengths[i] = 9;
+    for (; i < 280; i++) lengths[i] = 7;
+    for (; i < 288; i++) lengths[i] = 8;
+    build(d->fixed_litlen, LITLEN_BITS, lengths, 288, 0);
+    for (i = 0; i < 30; i++) lengths[i] = 5;
+    build(d->fixed_dist, DIST_BITS, lengths, 30, 1);
+    d->fixed_built = 1;
+}
+
+/* Read a dynamic block's codes into the decoder's tables. The code for
+   the code lengths is read with the literal/length table, before it is
+   built. */
+static int read_codes(decoder *d) {
+    bit_reader *in = &d->in;
+    unsigned char lengths[320], code_lengths[19] = {0};
+    uint32_t *codes = d->litlen, entry;
+    int litlens, dists, count, i, n, symbol, repeat, value;
+
+    refill(in);
+    litlens = take(in, 5) + 257;
+    dists = take(in, 5) + 1;
+    count = take(in, 4) + 4;
+    if (litlens > 286 || dists > 30)
+        return 0;
+    for (i = 0; i < count; i++) {
+        if (in->count < 3)
+            refill(in);
+        code_lengths[code_order[i]] = take(in, 3);
+    }
+    if (!build(codes, CODES_BITS, code_lengths, 19, 0))
+        return 0;
+
+    for (n = 0; n < litlens + dists;) {
+        refill(in);
+        entry = decode(in, codes, CODES_BITS);
+        if (entry == 0)
+            return 0;
+        symbol = entry & 0xffff;
+        if (symbol < 16) {
+            lengths[n++] = symbol;
+            continue;
+        }
+        if (symbol == 16) {
+            if (n == 0)
+                return 0;
+            value = lengths[n - 1];
+            repeat = 3 + take(in, 2);
+        } else if (symbol == 17) {
+            value = 0;
+            repeat = 3 + take(in, 3);
+        } else {
+            value = 0;
+            repeat = 11 + take(in, 7);
+        }
+        if (n + repeat > litlens + dists)
+            return 0;
+        while (repeat-- > 0)
+            lengths[n++] = value;
+    }
+    if (lengths[256] == 0 || overrun(in))
+        return 0;
+    return build(d->litlen, LITLEN_BITS, lengths, litlens, 0) &&
+        build(d->dist, DIST_BITS, lengths + litlens, dists, 1);
+}
+
+/* Decode the block at the current position. Returns -1 if it isn't valid,
+   1 if it was the last of its member, 0 otherwise. */
+static int inflate_block(decoder *d, int text) {
+    bit_reader *in = &d->in;
+    int final, type, ok;
+
+    refill(in);
+    final = take(in, 1);
+    type = take(in, 2);
+    if (type == 0) {
+        ok = inflate_stored(d, text);
+    } else if (type == 1) {
+        if (!d->fixed_built)
+            build_fixed(d);
+        ok = inflate_codes(d, d->fixed_litlen, d->fixed_dist, text);
+    } else if (type == 2) {
+        ok = read_codes(d) && inflate_codes(d, d->litlen, d->dist, text);
+    } else {
+        ok = 0;
+    }
+    if (!ok || overrun(in))
+        return -1;
+    return final;
+}
+
+long deflate_gzip_header(const unsigned char *data, size_t size) {
+    size_t length = 10;
+    int flags;
+
+    if ((size >= 1 && data[0] != 0x1f) || (size >= 2 && data[1] != 0x8b) ||
+        (size >= 3 && data[2] != 8) || (size >= 4 && (data[3] & 0xe0)))
+        return -1;
+    if (size < 10)
+        return 0;
+    flags = data[3];
+    if (flags & 4) {
+        if (size < 12)
+            return 0;
+        length += 2 + (data[10] | data[11] << 8);
+    }
+    if (flags & 8) {
+        while (length < size && data[length] != 0)
+            length++;
+        length++;
+    }
+    if (flags & 16) {
+        while (length < size && data[length] != 0)
+            length++;
+        length++;
+    }
+    if (flags & 2)
+        length += 2;
+    return (length <= size)?(long)length:0;
+}
+
+int deflate_dynamic_start(const unsigned char *data, size_t size, uint64_t bit) {
+    uint64_t byte = bit >> 3;
+    unsigned header;
+
+    if (byte >= size)
+        return 0;
+    header = data[byte];
+    if (byte + 1 < size)
+        header |= data[byte + 1] << 8;
+    return ((header >> (bit & 7)) & 7) == 4;
+}
+
+/* Whether a non-final dynamic block with a plausible header starts at `bit`:
+   at most 286 literal/length and 30 distance codes */
+static int maybe_dynamic(const unsigned char *data, size_t size, uint64_t bit) {
+    uint64_t byte = bit >> 3;
+    uint32_t header;
+
+    if (byte + 3 >= size)
+        return 0;
+    header = (data[byte] | data[byte + 1] << 8 | data[byte + 2] << 16 |
+              (uint32_t)data[byte + 3] << 24) >> (bit & 7);
+    return (header & 7) == 4 && ((header >> 3) & 31) <= 29 && ((header >> 8) & 31) <= 29;
+}
+
+static void add_end(deflate_part *part, const unsigned char *trailer) {
+    if (part->ends_used == part->ends_capacity) {
+        part->ends_capacity = (part->ends_capacity > 0)?2*part->ends_capacity:16;
+        part->ends = realloc(part->ends, part->ends_capacity*sizeof(deflate_member_end));
+    }
+    part->ends[part->ends_used].output = part->length;
+    part->ends[part->ends_used].crc = le32(trailer);
+    part->ends[part->ends_used].size = le32(trailer + 4);
+    part->ends_used++;
+}
+
+/* Decode from `start`, a member header if `member`, to the first start at
+   or after `to`. The first block must decode to text. */
+static int decode_from(decoder *d, uint64_t start, int member, int last, uint64_t to) {
+    const unsigned char *data = d->in.data;
+    size_t size = d->in.size, at;
+    deflate_part *part = d->part;
+    uint64_t bit;
+    long header;
+    int final;
+
+    part->length = part->ends_used = 0;
+    d->floor = 0;
+    d->markers = !member;
+    if (member) {
+        header = deflate_gzip_header(data + (start >> 3), size - (start >> 3));
+        if (header <= 0)
+            return 0;
+        seek(&d->in, start + 8*header);
+    } else {
+        seek(&d->in, start);
+    }
+    final = inflate_block(d, 1);
+
+    for (;;) {
+        if (final < 0)
+            return 0;
+        if (final) {
+            /* The member's trailer, then perhaps another member */
+            take(&d->in, d->in.count & 7);
+            at = position(&d->in) >> 3;
+            if (at + 8 > size)
+                return 0;
+            add_end(part, data + at);
+            at += 8;
+            if (at == size || data[at] != 0x1f || (at + 1 < size && data[at + 1] != 0x8b)) {
+                if (at == size && !last)
+                    return 0;
+                part->end = (uint64_t)at*8;
+                part->end_kind = DEFLATE_END;
+                return 1;
+            }
+            if ((uint64_t)at*8 >= to) {
+                part->end = (uint64_t)at*8;
+                part->end_kind = DEFLATE_MEMBER;
+                return 1;
+            }
+            header = deflate_gzip_header(data + at, size - at);
+            if (header <= 0)
+                return 0;
+            seek(&d->in, (at + header)*8);
+            d->floor = part->length;
+            d->markers = 0;
+        }
+        bit = position(&d->in);
+        if (bit >= to && deflate_dynamic_start(data, size, bit)) {
+            part->end = bit;
+            part->end_kind = DEFLATE_BLOCK;
+            return 1;
+        }
+        final = inflate_block(d, 0);
+    }
+}
+
+int deflate_decode_part(const unsigned char *data, size_t size, int last, uint64_t to,
+                        deflate_part *part) {
+    decoder *d = malloc(sizeof(decoder));
+    uint64_t bit, end = (uint64_t)size*8;
+    int ok = 0;
+
+    d->in.data = data;
+    d->in.size = size;
+    d->part = part;
+    d->limit = (size + 1)*(size_t)MAX_RATIO;
+    d->fixed_built = 0;
+
+    /* A guess that turns out wrong further on is dropped for the next one */
+    for (bit = 0; bit < to && bit < end && !ok; bit++) {
+        if ((bit & 7) == 0 && data[bit >> 3] == 0x1f && decode_from(d, bit, 1, last, to)) {
+            part->start_kind = DEFLATE_MEMBER;
+            ok = 1;
+        } else if (maybe_dynamic(data, size, bit) && decode_from(d, bit, 0, last, to)) {
+            part->start_kind = DEFLATE_BLOCK;
+            ok = 1;
+        }
+        part->start = bit;
+    }
+    if (!ok)
+        part->length = part->ends_used = 0;
+    free(d);
+    return ok;
+}
+
+void deflate_part_free(deflate_part *part) {
+    free(part->symbols);
+    free(part->ends);
+    memset(part, 0, sizeof(deflate_part));
+}
@@ -0,0 +1,65 @@
+#ifndef __DEFLATE_H
+#define __DEFLATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Decoding a gzip file from part way through, so parts of it can be
+   inflated in parallel, as pugz (Kerbiriou and Chikhi, 2019) and rapidgzip
+   (Knespel and Brunst, 2023) do.
+
+   A part starts at the first place in it where a gzip member or a non-final
+   dynamic Huffman block seems to start, and ends at the first such place
+   from the start of the next part on, so that the parts follow on from
+   each other. A guess is only taken if its first block decodes to text.
+   Back references into the 32 KB of output before the part, not yet known,
+   come out as markers, resolved once the part before has been decoded. A
+   wrong guess gives a part that doesn't start where the one before ended,
+   and is decoded again from there.
+
+   Decoded output is 16-bit: bytes below 256 and, from DEFLATE_MARKER up,
+   byte `symbol - DEFLATE_MARKER` of the DEFLATE_WINDOW bytes of output
+   before the part, the last of them at DEFLATE_WINDOW - 1. */
+#define DEFLATE_WINDOW 32768
+#define DEFLATE_MARKER 0x8000
+
+/* What is at either end of a part: the start of a member's header, of a
+   block, or the end of the file, or of the gzip data in it */
+enum { DEFLATE_MEMBER, DEFLATE_BLOCK, DEFLATE_END };
+
+/* The trailer of a member that ended in a part, after `output` symbols */
+typedef struct {
+    uint64_t output;
+    uint32_t crc, size;
+} deflate_member_end;
+
+/* A decoded part. `start` and `end` are bit positions in its data, the
+   first bit of a byte being its lowest. */
+typedef struct {
+    uint16_t *symbols;
+    size_t length, capacity;
+    deflate_member_end *ends;
+    size_t ends_used, ends_capacity;
+    uint64_t start, end;
+    int start_kind, end_kind;
+} deflate_part;
+
+/* Decode the part of `data`, `size` bytes, that starts before bit `to`:
+   from the first start found before `to` to the first at or after it.
+   `last` says whether `data` runs to the end of the file. Returns 0 if no
+   start was found, or the data ran out or was not valid deflate before the
+   end. */
+int deflate_decode_part(const unsigned char *data, size_t size, int last, uint64_t to,
+                        deflate_part *part);
+
+/* Release a part's buffers */
+void deflate_part_free(deflate_part *part);
+
+/* Length of the gzip member header at `data`, of which `size` bytes are
+   there. Returns 0 if it runs on past them, -1 if it is not one. */
+long deflate_gzip_header(const unsigned char *data, size_t size);
+
+/* Whether a non-final dynamic Huffman block starts at bit `bit` of `data` */
+int deflate_dynamic_start(const unsigned char *data, size_t size, uint64_t bit);
+
+#endif
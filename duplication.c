@@ -0,0 +1,195 @@
+#include "duplication.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define unlikely(x) __builtin_expect ((x), 0)
+
+const uint64_t duplication_level_start[DUPLICATION_LEVELS] = {
+    1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 50, 100, 500, 1000, 5000, 10000
+};
+
+static uint64_t load64(const char *p) {
+    uint64_t word;
+    memcpy(&word, p, 8);
+    return word;
+}
+
+static uint64_t mix(uint64_t h, uint64_t word) {
+    h = (h ^ word)*0xBF58476D1CE4E5B9ULL;
+    return h ^ (h >> 31);
+}
+
+/* Hash of a read, 8 bases at a time in two independent lanes, with a final
+   mix so every bit of the result depends on every base. The last word of a
+   read that is not a multiple of 8 long overlaps the one before. */
+uint64_t duplication_hash(const char *seq, uint64_t length) {
+    uint64_t a, b = 0x94D049BB133111EBULL, h, i;
+
+    if (length > DUPLICATION_TRUNCATE)
+        length = DUPLICATION_PREFIX;
+    a = length*0x9E3779B97F4A7C15ULL;
+    if (length >= 8) {
+        for (i = 0; i + 16 <= length; i += 16) {
+            a = mix(a, load64(seq + i));
+            b = mix(b, load64(seq + i + 8));
+        }
+        if (i + 8 <= length) {
+            a = mix(a, load64(seq + i));
+            i += 8;
+        }
+        if (i < length)
+            b = mix(b, load64(seq + length - 8));
+    } else {
+        for (i = 0; i < length; i++)
+            a = (a << 8) | (unsigned char)seq[i];
+    }
+    h = a ^ ((b << 32) | (b >> 32));
+    h = (h ^ (h >> 30))*0xBF58476D1CE4E5B9ULL;
+    h = (h ^ (h >> 27))*0x94D049BB133111EBULL;
+    return h ^ (h >> 31);
+}
+
+static void allocate(duplication_sketch *sketch) {
+    sketch->registers = calloc(DUPLICATION_REGISTERS, 1);
+    sketch->table = calloc(DUPLICATION_SLOTS, sizeof(duplication_entry));
+}
+
+static int sampled(uint64_t hash, int level) {
+    return (hash & ((1ULL << level) - 1)) == 0;
+}
+
+/* Add `count` reads of `hash`, which must be sampled. Slots are picked by
+   the top bits, as the bottom ones are zero in a sample. */
+static void place(duplication_sketch *sketch, uint64_t hash, uint64_t count) {
+    uint64_t slot = hash >> (64 - DUPLICATION_SAMPLE_BITS - 1);
+    duplication_entry *entry;
+
+    for (;; slot = (slot + 1) & (DUPLICATION_SLOTS - 1)) {
+        entry = &sketch->table[slot];
+        if (entry->count == 0)
+            break;
+        if (entry->hash == hash) {
+            entry->count += count;
+            return;
+        }
+    }
+    entry->hash = hash;
+    entry->count = count;
+    sketch->used++;
+}
+
+/* Sample at `level`, dropping sequences no longer sampled. Those kept are
+   put back in the same table, which stays in cache. */
+static void resample(duplication_sketch *sketch, int level) {
+    duplication_entry *kept = malloc(sketch->used*sizeof(duplication_entry));
+    uint64_t i, n = 0;
+
+    for (i = 0; i < DUPLICATION_SLOTS; i++)
+        if (sketch->table[i].count > 0 && sampled(sketch->table[i].hash, level))
+            kept[n++] = sketch->table[i];
+    memset(sketch->table, 0, DUPLICATION_SLOTS*sizeof(duplication_entry));
+    sketch->used = 0;
+    sketch->level = level;
+    for (i = 0; i < n; i++)
+        place(sketch, kept[i].hash, kept[i].count);
+    free(kept);
+}
+
+static void insert(duplication_sketch *sketch, uint64_t hash, uint64_t count) {
+    if (!sampled(hash, sketch->level))
+        return;
+    place(sketch, hash, count);
+    while (sketch->used > DUPLICATION_SAMPLE && sketch->level < 63)
+        resample(sketch, sketch->level + 1);
+}
+
+void duplication_add(duplication_sketch *sketch, uint64_t hash) {
+    uint8_t *r, rank;
+
+    if (unlikely(sketch->registers == NULL))
+        allocate(sketch);
+
+    /* The register is picked by the top bits and records the most leading
+       zeros seen in the rest */
+    r = &sketch->registers[hash >> (64 - DUPLICATION_REGISTER_BITS)];
+    rank = __builtin_clzll((hash << DUPLICATION_REGISTER_BITS) | (1ULL << (DUPLICATION_REGISTER_BITS - 1))) + 1;
+    if (rank > *r)
+        *r = rank;
+
+    if (unlikely(sampled(hash, sketch->level)))
+        insert(sketch, hash, 1);
+}
+
+void duplication_add_sample(duplication_sketch *sketch, const uint8_t *registers, int level,
+                            const duplication_entry *entries, uint64_t count) {
+    uint64_t i;
+
+    if (sketch->registers == NULL)
+        allocate(sketch);
+    for (i = 0; i < DUPLICATION_REGISTERS; i++)
+        if (registers[i] > sketch->registers[i])
+            sketch->registers[i] = registers[i];
+    if (level > sketch->level)
+        resample(sketch, level);
+    for (i = 0; i < count; i++)
+        if (entries[i].count > 0)
+            insert(sketch, entries[i].hash, entries[i].count);
+}
+
+void duplication_merge(duplication_sketch *to, const duplication_sketch *from) {
+    if (from->registers != NULL)
+        duplication_add_sample(to, from->registers, from->level, from->table, DUPLICATION_SLOTS);
+}
+
+void duplication_copy(duplication_sketch *to, const duplication_sketch *from) {
+    *to = *from;
+    if (from->registers == NULL)
+        return;
+    allocate(to);
+    memcpy(to->registers, from->registers, DUPLICATION_REGISTERS);
+    memcpy(to->table, from->table, DUPLICATION_SLOTS*sizeof(duplication_entry));
+}
+
+uint64_t duplication_distinct(const duplication_sketch *sketch) {
+    double m = DUPLICATION_REGISTERS, sum = 0, estimate;
+    int i, zeros = 0;
+
+    if (sketch->registers == NULL)
+        return 0;
+    if (sketch->level == 0)
+        return sketch->used;
+
+    for (i = 0; i < DUPLICATION_REGISTERS; i++) {
+        sum += ldexp(1, -sketch->registers[i]);
+        zeros += (sketch->registers[i] == 0);
+    }
+    estimate = 0.7213/(1 + 1.079/m)*m*m/sum;
+    /* Linear counting is better while many registers are still empty */
+    if (estimate <= 2.5*m && zeros > 0)
+        estimate = m*log(m/zeros);
+    return (uint64_t)(estimate + 0.5);
+}
+
+void duplication_levels(const duplication_sketch *sketch, uint64_t *sequences, uint64_t *reads) {
+    uint64_t i;
+    int level;
+
+    memset(sequences, 0, DUPLICATION_LEVELS*sizeof(uint64_t));
+    memset(reads, 0, DUPLICATION_LEVELS*sizeof(uint64_t));
+    for (i = 0; sketch->table != NULL && i < DUPLICATION_SLOTS; i++) {
+        if (sketch->table[i].count == 0)
+            continue;
+        for (level = DUPLICATION_LEVELS - 1; duplication_level_start[level] > sketch->table[i].count; level--)
+            ;
+        sequences[level]++;
+        reads[level] += sketch->table[i].count;
+    }
+}
+
+void duplication_free(duplication_sketch *sketch) {
+    free(sketch->registers);
+    free(sketch->table);
+    memset(sketch, 0, sizeof(duplication_sketch));
+}
@@ -0,0 +1,76 @@
+#ifndef __DUPLICATION_H
+#define __DUPLICATION_H
+
+#include <stdint.h>
+
+/* Duplicate reads, estimated in fixed memory.
+
+   Each read is hashed, using only its first DUPLICATION_PREFIX bases if it
+   is longer than DUPLICATION_TRUNCATE, as FastQC does, so that errors late in
+   long reads don't hide duplicates. The hashes feed:
+     - a HyperLogLog of DUPLICATION_REGISTERS one byte registers, estimating
+       the number of distinct reads
+     - an exact count of the reads of every sequence whose hash ends in at
+       least `level` zero bits, a 1 in 2^level sample of the distinct
+       sequences. When more than DUPLICATION_SAMPLE are kept, the level goes
+       up and those no longer sampled are dropped.
+   The sample does not depend on the order reads come in, so sketches of
+   parts of a file add up to exactly the sketch of the whole. Until the
+   level first goes up, every sequence is counted and all figures are exact.
+
+   Memory is allocated on the first read: 16 KB of registers and a 512 KB
+   table. */
+#define DUPLICATION_TRUNCATE      75
+#define DUPLICATION_PREFIX        50
+#define DUPLICATION_REGISTER_BITS 14
+#define DUPLICATION_REGISTERS     (1 << DUPLICATION_REGISTER_BITS)
+#define DUPLICATION_SAMPLE_BITS   14
+#define DUPLICATION_SAMPLE        (1 << DUPLICATION_SAMPLE_BITS)
+/* Table slots; kept at most half full */
+#define DUPLICATION_SLOTS         (2*DUPLICATION_SAMPLE)
+
+/* Duplication levels reported, as the fewest copies in each: 1 to 9, then
+   10+, 50+, 100+, 500+, 1k+, 5k+ and 10k+ */
+#define DUPLICATION_LEVELS 16
+extern const uint64_t duplication_level_start[DUPLICATION_LEVELS];
+
+/* A sampled sequence and its number of reads; empty slots have no reads */
+typedef struct {
+    uint64_t hash;
+    uint64_t count;
+} duplication_entry;
+
+typedef struct {
+    uint8_t *registers;
+    duplication_entry *table;
+    uint64_t used;
+    int level;
+} duplication_sketch;
+
+/* Hash of a read, over the bases compared for duplicates */
+uint64_t duplication_hash(const char *seq, uint64_t length);
+
+/* Count one read, given its duplication_hash. An all zero sketch is empty. */
+void duplication_add(duplication_sketch *sketch, uint64_t hash);
+
+/* Add `entries` sampled sequences, sampled at `level`, and HyperLogLog
+   `registers` to `sketch`. Empty entries are skipped. */
+void duplication_add_sample(duplication_sketch *sketch, const uint8_t *registers, int level,
+                            const duplication_entry *entries, uint64_t count);
+
+/* Add the counts of `from` to `to` */
+void duplication_merge(duplication_sketch *to, const duplication_sketch *from);
+
+/* Copy of `from` in `to` */
+void duplication_copy(duplication_sketch *to, const duplication_sketch *from);
+
+/* Estimated number of distinct reads; exact while the level is 0 */
+uint64_t duplication_distinct(const duplication_sketch *sketch);
+
+/* Sampled sequences, and their reads, at each duplication level */
+void duplication_levels(const duplication_sketch *sketch, uint64_t *sequences, uint64_t *reads);
+
+/* Release a sketch, leaving it empty */
+void duplication_free(duplication_sketch *sketch);
+
+#endif
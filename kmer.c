@@ -0,0 +1,219 @@
+#include "kmer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Marks an empty hash slot; never a valid k-mer since k <= 31 */
+#define KMER_EMPTY UINT64_MAX
+
+/* Ends a list of k-mer sites */
+#define KMER_NO_SITE UINT32_MAX
+
+/* Hashed k-mers also set one bit in a 16 KB filter, so most probes of a read
+   that holds no adapter are a single L1 load */
+#define KMER_FILTER_BITS 17
+
+/* Convert ASCII to Integer for A T C and G. Anything else counts as A */
+unsigned char base_code[256] = {
+    ['T'] = 1, ['t'] = 1,
+    ['C'] = 2, ['c'] = 2,
+    ['G'] = 3, ['g'] = 3
+};
+
+
+static inline uint64_t kmer_hash(uint64_t kmer) {
+    return kmer * 0x9E3779B97F4A7C15ULL;
+}
+
+static inline uint64_t kmer_slot(const kmer_index *index, uint64_t kmer) {
+    return (kmer_hash(kmer) >> 32) & index->table_mask;
+}
+
+/* Slot holding `kmer`, or the empty slot where it would go */
+static inline uint64_t kmer_find(const kmer_index *index, uint64_t kmer) {
+    uint64_t slot = kmer_slot(index, kmer);
+    while (index->table[slot] != KMER_EMPTY && index->table[slot] != kmer)
+        slot = (slot + 1) & index->table_mask;
+    return slot;
+}
+
+static inline int kmer_hashed(const kmer_index *index, uint64_t kmer) {
+    uint64_t bit = kmer_hash(kmer) >> (64 - KMER_FILTER_BITS);
+    uint64_t slot;
+
+    if (!(index->filter[bit >> 6] >> (bit & 63) & 1))
+        return 0;
+
+    slot = kmer_find(index, kmer);
+    return index->table[slot] != KMER_EMPTY;
+}
+
+/* Allocate an empty hash table of `size` slots, a power of 2 */
+static void kmer_table_alloc(kmer_index *index, uint64_t size) {
+    index->table = malloc(size*sizeof(uint64_t));
+    memset(index->table, 0xff, size*sizeof(uint64_t));
+    index->heads = malloc(size*sizeof(uint32_t));
+    index->table_mask = size - 1;
+}
+
+/* Double the hash table, keeping it at most half full */
+static void kmer_grow(kmer_index *index) {
+    uint64_t *old = index->table;
+    uint32_t *old_heads = index->heads;
+    uint64_t i, slot, size = index->table_mask + 1;
+
+    kmer_table_alloc(index, 2*size);
+    for (i = 0; i < size; i++) {
+        if (old[i] != KMER_EMPTY) {
+            slot = kmer_find(index, old[i]);
+            index->table[slot] = old[i];
+            index->heads[slot] = old_heads[i];
+        }
+    }
+    free(old);
+    free(old_heads);
+}
+
+/* Record that `kmer` occurs at `offset` in `adapter` */
+static void kmer_insert(kmer_index *index, uint64_t kmer, int adapter, uint64_t offset) {
+    uint64_t slot;
+    kmer_site *site;
+
+    if (2*(index->count + 1) > index->table_mask + 1)
+        kmer_grow(index);
+    slot = kmer_find(index, kmer);
+    if (index->table[slot] == KMER_EMPTY) {
+        index->table[slot] = kmer;
+        index->heads[slot] = KMER_NO_SITE;
+        index->count++;
+    }
+
+    if (index->sites_length == index->sites_capacity) {
+        index->sites_capacity = (index->sites_capacity > 0)?2*index->sites_capacity:1024;
+        index->sites = realloc(index->sites, index->sites_capacity*sizeof(kmer_site));
+    }
+    site = &index->sites[index->sites_length];
+    site->adapter = adapter;
+    site->offset = offset;
+    site->next = index->heads[slot];
+    index->heads[slot] = index->sites_length++;
+}
+
+kmer_index* kmer_index_init(int kmer_size) {
+    kmer_index *index = calloc(1, sizeof(kmer_index));
+
+    index->kmer_size = kmer_size;
+    index->mask = (1ULL << 2*kmer_size) - 1;
+
+    if (kmer_size <= KMER_BITSET_MAX)
+        index->bits = calloc(((1ULL << 2*kmer_size) + 63)/64, sizeof(uint64_t));
+    else
+        index->filter = calloc((1 << KMER_FILTER_BITS)/64, sizeof(uint64_t));
+    kmer_table_alloc(index, 1024);
+    return index;
+}
+
+int kmer_index_add(kmer_index *index, const char *name, const char *seq, uint64_t length) {
+    uint64_t i, kmer = 0;
+    int adapter = index->adapters++;
+    unsigned char *codes = malloc(length + 1);
+
+    index->names = realloc(index->names, index->adapters*sizeof(char*));
+    index->codes = realloc(index->codes, index->adapters*sizeof(unsigned char*));
+    index->lengths = realloc(index->lengths, index->adapters*sizeof(uint64_t));
+    index->names[adapter] = strdup(name);
+    index->codes[adapter] = codes;
+    index->lengths[adapter] = length;
+
+    for (i = 0; i < length; i++) {
+        codes[i] = base_code[(unsigned char)seq[i]];
+        kmer = ((kmer << 2) | codes[i]) & index->mask;
+        if (i + 1 < index->kmer_size)
+            continue;
+
+        if (index->bits) {
+            index->bits[kmer >> 6] |= 1ULL << (kmer & 63);
+        } else {
+            uint64_t bit = kmer_hash(kmer) >> (64 - KMER_FILTER_BITS);
+            index->filter[bit >> 6] |= 1ULL << (bit & 63);
+        }
+        kmer_insert(index, kmer, adapter, i + 1 - index->kmer_size);
+    }
+    return adapter;
+}
+
+uint64_t kmer_index_scan(const kmer_index *index, const char *seq, uint64_t length) {
+    uint64_t i, k, kmer = 0, mask = index->mask;
+    const uint64_t *bits = index->bits;
+
+    if (length <= index->kmer_size)
+        return length;
+
+    for (i = 0; i < index->kmer_size; i++)
+        kmer = (kmer << 2) | base_code[(unsigned char)seq[i]];
+
+    /* Separate loops so the bitset probe stays a single load. Older bases are
+       masked off when probing rather than when shifting, keeping the mask off
+       the loop-carried dependency */
+    if (bits) {
+        for (; k = kmer & mask, !(bits[k >> 6] >> (k & 63) & 1) && i < length; i++)
+            kmer = (kmer << 2) | base_code[(unsigned char)seq[i]];
+    } else {
+        for (; !kmer_hashed(index, kmer & mask) && i < length; i++)
+            kmer = (kmer << 2) | base_code[(unsigned char)seq[i]];
+    }
+    return i;
+}
+
+int kmer_index_attribute(const kmer_index *index, const char *seq, uint64_t length, uint64_t end) {
+    uint64_t i, kmer = 0, start = end - index->kmer_size;
+    uint64_t slot, read, at, matched, best_matched = 0;
+    uint32_t s;
+    int best = -1;
+
+    for (i = start; i < end; i++)
+        kmer = (kmer << 2) | base_code[(unsigned char)seq[i]];
+    slot = kmer_find(index, kmer);
+    if (index->table[slot] == KMER_EMPTY)
+        return -1;
+
+    for (s = index->heads[slot]; s != KMER_NO_SITE; s = index->sites[s].next) {
+        const kmer_site *site = &index->sites[s];
+        const unsigned char *codes = index->codes[site->adapter];
+
+        matched = index->kmer_size;
+        for (read = end, at = site->offset + index->kmer_size;
+             read < length && at < index->lengths[site->adapter] &&
+                 base_code[(unsigned char)seq[read]] == codes[at];
+             read++, at++)
+            matched++;
+        for (read = start, at = site->offset;
+             read > 0 && at > 0 && base_code[(unsigned char)seq[read-1]] == codes[at-1];
+             read--, at--)
+            matched++;
+
+        if (matched > best_matched || (matched == best_matched && (int)site->adapter < best)) {
+            best_matched = matched;
+            best = site->adapter;
+        }
+    }
+    return best;
+}
+
+void kmer_index_free(kmer_index *index) {
+    int i;
+
+    for (i = 0; i < index->adapters; i++) {
+        free(index->names[i]);
+        free(index->codes[i]);
+    }
+    free(index->names);
+    free(index->codes);
+    free(index->lengths);
+    free(index->sites);
+    free(index->bits);
+    free(index->filter);
+    free(index->table);
+    free(index->heads);
+    free(index);
+}
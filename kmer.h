@@ -0,0 +1,69 @@
+#ifndef __KMER_H
+#define __KMER_H
+
+#include <stdint.h>
+
+/* Largest k-mer that fits in 64 bits at 2 bits per base (minus a spare bit
+   pattern used to mark empty hash slots) */
+#define KMER_MAX_SIZE 31
+
+/* Largest k-mer kept in a plain bitset; 4^10 bits is 128 KB */
+#define KMER_BITSET_MAX 10
+
+/* Convert ASCII to Integer for A T C and G (0, 1, 2, 3). Anything else
+   counts as A */
+extern unsigned char base_code[256];
+
+/* Where a k-mer occurs: adapter number, offset in that adapter, and the next
+   site of the same k-mer */
+typedef struct {
+    uint32_t adapter;
+    uint32_t offset;
+    uint32_t next;
+} kmer_site;
+
+/* Set of adapter k-mers, each packed 2 bits per base.
+
+   Reads are scanned against a bitset indexed by the k-mer itself for small k,
+   or a small bit filter for larger k. Both sit in front of an open addressing
+   hash table, which only grows with the number of adapter k-mers and links
+   every k-mer to the adapters it came from. */
+typedef struct {
+    int kmer_size;
+    uint64_t mask;
+    uint64_t *bits;
+    uint64_t *filter;
+    uint64_t *table;
+    uint32_t *heads;
+    uint64_t table_mask;
+    uint64_t count;
+
+    kmer_site *sites;
+    uint32_t sites_length, sites_capacity;
+
+    int adapters;
+    char **names;
+    unsigned char **codes;
+    uint64_t *lengths;
+} kmer_index;
+
+/* Create an empty index for k-mers of `kmer_size` bases (1 to KMER_MAX_SIZE) */
+kmer_index* kmer_index_init(int kmer_size);
+
+/* Add an adapter and every k-mer of `seq` to the index. Returns the adapter
+   number, counting from 0 in the order added. */
+int kmer_index_add(kmer_index *index, const char *name, const char *seq, uint64_t length);
+
+/* Scan a read for adapter k-mers. Returns the position just past the first
+   k-mer found in the index, or `length` if there is none. */
+uint64_t kmer_index_scan(const kmer_index *index, const char *seq, uint64_t length);
+
+/* Work out which adapter a read holds, given the `end` returned by
+   kmer_index_scan. Every adapter sharing the k-mer is extended base by base
+   along the read in both directions and the longest match wins, ties going to
+   the adapter added first. Returns -1 if the k-mer is not in the index. */
+int kmer_index_attribute(const kmer_index *index, const char *seq, uint64_t length, uint64_t end);
+
+void kmer_index_free(kmer_index *index);
+
+#endif
@@ -0,0 +1,128 @@
+#include "mapped.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+mapped_file* mapped_open(const char *path) {
+    struct stat st;
+    void *data;
+    mapped_file *file;
+    int fd;
+
+    /* Checked before opening, since opening a named pipe would take the
+       data meant for the stream reader */
+    if (strcmp(path, "-") == 0 || stat(path, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+        return NULL;
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return NULL;
+
+    /* gzip starts with 0x1f, so this also turns away compressed input */
+    if (((const char*)data)[0] != '@') {
+        munmap(data, st.st_size);
+        return NULL;
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+    file = malloc(sizeof(mapped_file));
+    file->data = data;
+    file->length = st.st_size;
+    return file;
+}
+
+size_t mapped_record_start(const mapped_file *file, size_t offset) {
+    const char *data = file->data, *limit = data + file->length;
+    const char *line, *next;
+    int i;
+
+    if (offset == 0)
+        return 0;
+
+    /* Walk line starts from `offset` on */
+    line = memchr(data + offset - 1, '\n', limit - (data + offset - 1));
+    while (line != NULL && ++line < limit) {
+        if (*line == '@') {
+            for (i = 0, next = line; i < 2 && next != NULL; i++) {
+                next = memchr(next, '\n', limit - next);
+                if (next != NULL)
+                    next++;
+            }
+            if (next != NULL && next < limit && *next == '+')
+                return line - data;
+        }
+        line = memchr(line, '\n', limit - line);
+    }
+    return file->length;
+}
+
+int mapped_next(const mapped_file *file, size_t *pos, size_t end, mapped_record *record) {
+    const char *data = file->data, *limit = data + file->length;
+    const char *p = data + *pos;
+    uint64_t length;
+
+    while (p < data + end && (*p == '\n' || *p == '\r'))
+        p++;
+    if (p >= data + end) {
+        *pos = p - data;
+        return 0;
+    }
+    if (*p != '@')
+        return -1;
+
+    /* Header and bases; memchr is vectorised by the C library */
+    p = memchr(p, '\n', limit - p);
+    if (p == NULL)
+        return -1;
+    record->seq = ++p;
+    p = memchr(p, '\n', limit - p);
+    if (p == NULL)
+        return -1;
+    length = p - record->seq;
+    if (length > 0 && p[-1] == '\r')
+        length--;
+
+    /* The '+' line, nearly always bare */
+    if (++p >= limit || *p != '+')
+        return -1;
+    if (p + 1 < limit && p[1] == '\n') {
+        p += 2;
+    } else {
+        p = memchr(p, '\n', limit - p);
+        if (p == NULL)
+            return -1;
+        p++;
+    }
+
+    /* Qualities are as long as the bases, so only the line end is checked */
+    if ((uint64_t)(limit - p) < length)
+        return -1;
+    record->qual = p;
+    record->length = length;
+    p += length;
+    if (p < limit && *p == '\r')
+        p++;
+    if (p < limit) {
+        if (*p != '\n')
+            return -1;
+        p++;
+    }
+    *pos = p - data;
+    return 1;
+}
+
+void mapped_close(mapped_file *file) {
+    munmap((void*)file->data, file->length);
+    free(file);
+}
@@ -0,0 +1,38 @@
+#ifndef __MAPPED_H
+#define __MAPPED_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Uncompressed FASTQ file mapped into memory, so reads are tallied straight
+   from the page cache with no copy. Only four line records (header, bases,
+   '+', qualities) are parsed; anything else is left to kseq. */
+typedef struct {
+    const char *data;
+    size_t length;
+} mapped_file;
+
+/* One record, pointing into the mapping */
+typedef struct {
+    const char *seq, *qual;
+    uint64_t length;
+} mapped_record;
+
+/* Map `path` if it is a regular, non-empty, uncompressed FASTQ file. Returns
+   NULL otherwise (including "-" and pipes), and the file should be read as a
+   stream instead. */
+mapped_file* mapped_open(const char *path);
+
+/* Offset of the first record starting at or after `offset`, or the length of
+   the file if there is none. A record starts on a line beginning with '@'
+   whose next line but one begins with '+', which no quality line can fake. */
+size_t mapped_record_start(const mapped_file *file, size_t offset);
+
+/* Parse the record at `*pos` and move `*pos` past it. Blank lines before it
+   are skipped. Returns 1 for a record, 0 once `*pos` reaches `end`, and -1 if
+   the record is not a four line FASTQ record. */
+int mapped_next(const mapped_file *file, size_t *pos, size_t end, mapped_record *record);
+
+void mapped_close(mapped_file *file);
+
+#endif
@@ -0,0 +1,317 @@
+#include "overrepresented.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define unlikely(x) __builtin_expect ((x), 0)
+
+/* Index slots; kept at most half full */
+#define INDEX_BITS  12
+#define INDEX_SLOTS (1 << INDEX_BITS)
+
+/* No entry or bucket */
+#define NONE UINT32_MAX
+
+/* Drop every entry */
+static void clear(overrepresented_summary *summary) {
+    uint32_t i;
+
+    memset(summary->index, 0, INDEX_SLOTS*sizeof(overrepresented_slot));
+    for (i = 0; i < OVERREPRESENTED_COUNTERS; i++)
+        summary->buckets[i].up = (i + 1 < OVERREPRESENTED_COUNTERS)?i + 1:NONE;
+    summary->spare = 0;
+    summary->lowest = NONE;
+    summary->used = 0;
+}
+
+static void allocate(overrepresented_summary *summary) {
+    summary->entries = calloc(OVERREPRESENTED_COUNTERS, sizeof(overrepresented_entry));
+    summary->links = malloc(OVERREPRESENTED_COUNTERS*sizeof(overrepresented_link));
+    summary->buckets = malloc(OVERREPRESENTED_COUNTERS*sizeof(overrepresented_bucket));
+    summary->index = malloc(INDEX_SLOTS*sizeof(overrepresented_slot));
+    clear(summary);
+}
+
+static uint32_t home(uint64_t hash) {
+    return hash >> (64 - INDEX_BITS);
+}
+
+/* Slot holding `hash`, or the empty slot where it would go */
+static overrepresented_slot* find(overrepresented_summary *summary, uint64_t hash) {
+    uint32_t slot = home(hash);
+
+    for (;; slot = (slot + 1) & (INDEX_SLOTS - 1))
+        if (summary->index[slot].entry == 0 || summary->index[slot].hash == hash)
+            return &summary->index[slot];
+}
+
+/* Take `hash` out of the index, moving back later slots of the same run
+   that could no longer be found */
+static void unindex(overrepresented_summary *summary, uint64_t hash) {
+    uint32_t i = find(summary, hash) - summary->index, j = i, k;
+
+    summary->index[i].entry = 0;
+    for (;;) {
+        j = (j + 1) & (INDEX_SLOTS - 1);
+        if (summary->index[j].entry == 0)
+            return;
+        k = home(summary->index[j].hash);
+        /* Leave it if its home is after the gap, up to where it is */
+        if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j))
+            continue;
+        summary->index[i] = summary->index[j];
+        summary->index[j].entry = 0;
+        i = j;
+    }
+}
+
+/* A bucket of `count` reads between `down` and `up` */
+static uint32_t new_bucket(overrepresented_summary *summary, uint64_t count, uint32_t down, uint32_t up) {
+    uint32_t b = summary->spare;
+    overrepresented_bucket *bucket = &summary->buckets[b];
+
+    summary->spare = bucket->up;
+    bucket->count = count;
+    bucket->first = NONE;
+    bucket->up = up;
+    bucket->down = down;
+    if (down != NONE)
+        summary->buckets[down].up = b;
+    else
+        summary->lowest = b;
+    if (up != NONE)
+        summary->buckets[up].down = b;
+    return b;
+}
+
+static void drop_bucket(overrepresented_summary *summary, uint32_t b) {
+    overrepresented_bucket *bucket = &summary->buckets[b];
+
+    if (bucket->down != NONE)
+        summary->buckets[bucket->down].up = bucket->up;
+    else
+        summary->lowest = bucket->up;
+    if (bucket->up != NONE)
+        summary->buckets[bucket->up].down = bucket->down;
+    bucket->up = summary->spare;
+    summary->spare = b;
+}
+
+static void link_entry(overrepresented_summary *summary, uint32_t n, uint32_t b) {
+    overrepresented_link *link = &summary->links[n];
+
+    link->bucket = b;
+    link->prev = NONE;
+    link->next = summary->buckets[b].first;
+    if (link->next != NONE)
+        summary->links[link->next].prev = n;
+    summary->buckets[b].first = n;
+}
+
+static void unlink_entry(overrepresented_summary *summary, uint32_t n) {
+    overrepresented_link *link = &summary->links[n];
+
+    if (link->prev != NONE)
+        summary->links[link->prev].next = link->next;
+    else
+        summary->buckets[link->bucket].first = link->next;
+    if (link->next != NONE)
+        summary->links[link->next].prev = link->prev;
+}
+
+/* One more read for entry `n` */
+static void increment(overrepresented_summary *summary, uint32_t n) {
+    uint32_t b = summary->links[n].bucket, up = summary->buckets[b].up;
+    uint64_t count = summary->buckets[b].count + 1;
+
+    summary->entries[n].count = count;
+    if (up != NONE && summary->buckets[up].count == count) {
+        unlink_entry(summary, n);
+        link_entry(summary, n, up);
+        if (summary->buckets[b].first == NONE)
+            drop_bucket(summary, b);
+    } else if (summary->buckets[b].first == n && summary->links[n].next == NONE) {
+        /* Alone in its bucket, which can simply go up */
+        summary->buckets[b].count = count;
+    } else {
+        unlink_entry(summary, n);
+        link_entry(summary, n, new_bucket(summary, count, b, up));
+    }
+}
+
+/* Set entry `e` to `seq`, compared as duplication_hash does */
+static void set_sequence(overrepresented_entry *e, const char *seq, uint64_t length) {
+    if (length > DUPLICATION_TRUNCATE)
+        length = DUPLICATION_PREFIX;
+    memcpy(e->seq, seq, length);
+    e->seq[length] = '\0';
+    e->length = length;
+}
+
+void overrepresented_add(overrepresented_summary *summary, uint64_t hash, const char *seq,
+                         uint64_t length) {
+    overrepresented_entry *e;
+    overrepresented_slot *slot;
+    uint32_t n, b;
+
+    if (unlikely(summary->entries == NULL))
+        allocate(summary);
+
+    slot = find(summary, hash);
+    if (slot->entry != 0) {
+        increment(summary, slot->entry - 1);
+        return;
+    }
+
+    if (summary->used < OVERREPRESENTED_COUNTERS) {
+        n = summary->used++;
+        e = &summary->entries[n];
+        e->hash = hash;
+        e->count = 1;
+        e->error = 0;
+        set_sequence(e, seq, length);
+        slot->hash = hash;
+        slot->entry = n + 1;
+        b = summary->lowest;
+        if (b == NONE || summary->buckets[b].count != 1)
+            b = new_bucket(summary, 1, NONE, b);
+        link_entry(summary, n, b);
+        return;
+    }
+
+    /* Take over a sequence with the fewest reads */
+    summary->evicted = 1;
+    b = summary->lowest;
+    n = summary->buckets[b].first;
+    e = &summary->entries[n];
+    unindex(summary, e->hash);
+    e->hash = hash;
+    e->error = summary->buckets[b].count;
+    set_sequence(e, seq, length);
+    slot = find(summary, hash);
+    slot->hash = hash;
+    slot->entry = n + 1;
+    increment(summary, n);
+}
+
+/* Most reads first; ties are broken by sequence, so reports don't depend on
+   where entries were kept */
+static int by_count(const void *a, const void *b) {
+    const overrepresented_entry *x = a, *y = b;
+
+    if (x->count != y->count)
+        return (x->count > y->count)?-1:1;
+    return strcmp(x->seq, y->seq);
+}
+
+/* Add up two summaries as in "Mergeable Summaries" (Agarwal et al., 2012):
+   a sequence missing from a summary that dropped sequences may have had up
+   to that summary's fewest reads, which are added to its count and error.
+   The OVERREPRESENTED_COUNTERS highest counts are kept. */
+void overrepresented_add_entries(overrepresented_summary *summary, const overrepresented_entry *entries,
+                                 uint32_t count, int evicted) {
+    overrepresented_entry *all;
+    uint64_t own_min = 0, other_min = UINT64_MAX;
+    overrepresented_slot *slot;
+    uint32_t i, n, top = NONE;
+
+    if (count == 0)
+        return;
+    if (summary->entries == NULL)
+        allocate(summary);
+    if (summary->evicted)
+        own_min = summary->buckets[summary->lowest].count;
+    for (i = 0; i < count; i++)
+        if (entries[i].count < other_min)
+            other_min = entries[i].count;
+    if (!evicted)
+        other_min = 0;
+
+    all = malloc((summary->used + count)*sizeof(overrepresented_entry));
+    n = summary->used;
+    memcpy(all, summary->entries, n*sizeof(overrepresented_entry));
+    for (i = 0; i < n; i++) {
+        all[i].count += other_min;
+        all[i].error += other_min;
+    }
+    for (i = 0; i < count; i++) {
+        slot = find(summary, entries[i].hash);
+        if (slot->entry != 0) {
+            all[slot->entry - 1].count += entries[i].count - other_min;
+            all[slot->entry - 1].error += entries[i].error - other_min;
+        } else {
+            all[n] = entries[i];
+            all[n].count += own_min;
+            all[n].error += own_min;
+            n++;
+        }
+    }
+    qsort(all, n, sizeof(overrepresented_entry), by_count);
+
+    summary->evicted = summary->evicted || evicted || n > OVERREPRESENTED_COUNTERS;
+    if (n > OVERREPRESENTED_COUNTERS)
+        n = OVERREPRESENTED_COUNTERS;
+    clear(summary);
+    summary->used = n;
+    /* Fewest reads first, so buckets are added going up */
+    for (i = 0; i < n; i++) {
+        summary->entries[i] = all[n - 1 - i];
+        slot = find(summary, summary->entries[i].hash);
+        slot->hash = summary->entries[i].hash;
+        slot->entry = i + 1;
+        if (top == NONE || summary->buckets[top].count != summary->entries[i].count)
+            top = new_bucket(summary, summary->entries[i].count, top, NONE);
+        link_entry(summary, i, top);
+    }
+    free(all);
+}
+
+void overrepresented_merge(overrepresented_summary *to, const overrepresented_summary *from) {
+    if (from->entries != NULL)
+        overrepresented_add_entries(to, from->entries, from->used, from->evicted);
+}
+
+void overrepresented_copy(overrepresented_summary *to, const overrepresented_summary *from) {
+    *to = *from;
+    if (from->entries == NULL)
+        return;
+    allocate(to);
+    to->used = from->used;
+    to->lowest = from->lowest;
+    to->spare = from->spare;
+    memcpy(to->entries, from->entries, from->used*sizeof(overrepresented_entry));
+    memcpy(to->links, from->links, from->used*sizeof(overrepresented_link));
+    memcpy(to->buckets, from->buckets, OVERREPRESENTED_COUNTERS*sizeof(overrepresented_bucket));
+    memcpy(to->index, from->index, INDEX_SLOTS*sizeof(overrepresented_slot));
+}
+
+static int by_count_pointer(const void *a, const void *b) {
+    return by_count(*(const overrepresented_entry* const*)a, *(const overrepresented_entry* const*)b);
+}
+
+int overrepresented_top(const overrepresented_summary *summary, uint64_t reads,
+                        const overrepresented_entry **top) {
+    const overrepresented_entry **found;
+    uint32_t i, n = 0;
+
+    if (summary->entries == NULL || reads == 0)
+        return 0;
+    found = malloc(summary->used*sizeof(overrepresented_entry*));
+    for (i = 0; i < summary->used; i++)
+        if (summary->entries[i].count*OVERREPRESENTED_REPORT_FRACTION >= reads)
+            found[n++] = &summary->entries[i];
+    qsort(found, n, sizeof(overrepresented_entry*), by_count_pointer);
+    if (n > OVERREPRESENTED_REPORT_MAX)
+        n = OVERREPRESENTED_REPORT_MAX;
+    memcpy(top, found, n*sizeof(overrepresented_entry*));
+    free(found);
+    return n;
+}
+
+void overrepresented_free(overrepresented_summary *summary) {
+    free(summary->entries);
+    free(summary->links);
+    free(summary->buckets);
+    free(summary->index);
+    memset(summary, 0, sizeof(overrepresented_summary));
+}
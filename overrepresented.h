@@ -0,0 +1,96 @@
+#ifndef __OVERREPRESENTED_H
+#define __OVERREPRESENTED_H
+
+#include <stdint.h>
+
+#include "duplication.h"
+
+/* The most common read sequences, found with the Space-Saving algorithm in
+   fixed memory.
+
+   OVERREPRESENTED_COUNTERS sequences are followed, each with the reads
+   counted for it. A sequence not followed takes the place of the one with
+   the fewest reads, and carries on from its count, which becomes its
+   `error`. A sequence's reads are then between `count - error` and `count`,
+   and every sequence of more than 1 in OVERREPRESENTED_COUNTERS reads is
+   followed. Reads are compared as for duplicates, on their first
+   DUPLICATION_PREFIX bases if longer than DUPLICATION_TRUNCATE, using the
+   same hash.
+
+   Summaries of parts of a file add up to a summary of the whole with the
+   same guarantees, but which sequences are followed depends on the order
+   reads came in, so the counts can differ from those of a single pass.
+   Threaded runs therefore share one summary, added to in file order.
+
+   Memory, about 350 KB, is allocated on the first read. */
+#define OVERREPRESENTED_COUNTERS 2048
+/* Sequences listed in reports: those of at least 1 in
+   OVERREPRESENTED_REPORT_FRACTION reads, up to OVERREPRESENTED_REPORT_MAX */
+#define OVERREPRESENTED_REPORT_FRACTION 1000
+#define OVERREPRESENTED_REPORT_MAX 50
+
+typedef struct {
+    uint64_t hash;
+    uint64_t count;
+    uint64_t error;
+    uint32_t length;
+    char seq[DUPLICATION_TRUNCATE + 1];
+} overrepresented_entry;
+
+/* The entries with the same count, as a list through their links. Buckets
+   are themselves listed by count, so a read only moves its entry to the
+   next bucket up, as in the "Stream-Summary" of the Space-Saving paper. */
+typedef struct {
+    uint64_t count;
+    uint32_t first;
+    uint32_t up, down;
+} overrepresented_bucket;
+
+typedef struct {
+    uint32_t bucket;
+    uint32_t next, prev;
+} overrepresented_link;
+
+/* A slot of the index, with the entry number plus 1, or 0 if empty */
+typedef struct {
+    uint64_t hash;
+    uint32_t entry;
+} overrepresented_slot;
+
+/* `used` entries, found by hash through the open addressing `index`. `lowest` is the bucket with the fewest reads and
+   `spare` the first of the unused buckets. `evicted` is set once a sequence
+   has had to make room for another. */
+typedef struct {
+    overrepresented_entry *entries;
+    overrepresented_link *links;
+    overrepresented_bucket *buckets;
+    overrepresented_slot *index;
+    uint32_t used, lowest, spare;
+    int evicted;
+} overrepresented_summary;
+
+/* Count one read, given its duplication_hash. An all zero summary is
+   empty. */
+void overrepresented_add(overrepresented_summary *summary, uint64_t hash, const char *seq,
+                         uint64_t length);
+
+/* Add `count` entries of another summary to `summary`. `evicted` says
+   whether that summary had to drop any sequences. */
+void overrepresented_add_entries(overrepresented_summary *summary, const overrepresented_entry *entries,
+                                 uint32_t count, int evicted);
+
+/* Add the counts of `from` to `to` */
+void overrepresented_merge(overrepresented_summary *to, const overrepresented_summary *from);
+
+/* Copy of `from` in `to` */
+void overrepresented_copy(overrepresented_summary *to, const overrepresented_summary *from);
+
+/* The sequences to report out of `reads`, most reads first, in `top`, which
+   holds OVERREPRESENTED_REPORT_MAX. Returns how many there are. */
+int overrepresented_top(const overrepresented_summary *summary, uint64_t reads,
+                        const overrepresented_entry **top);
+
+/* Release a summary, leaving it empty */
+void overrepresented_free(overrepresented_summary *summary);
+
+#endif
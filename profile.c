@@ -0,0 +1,149 @@
+#include "profile.h"
+
+#include <pthread.h>
+#include <sys/resource.h>
+#include <time.h>
+
+int profile_enabled = 0;
+
+static const char *stage_names[PROFILE_STAGES] = {
+    "read", "inflate", "parse", "wait", "tally", "transform", "render"
+};
+
+static const char *counter_names[PROFILE_COUNTERS] = {
+    "bytes_compressed", "bytes_uncompressed", "reads", "bases", "adapter_probes", "adapter_hits"
+};
+
+/* This thread's totals, and the time it has spent in timed stages so far,
+   which enclosing stages leave out. Quick stages wait in `thread_quick` for
+   the enclosing stage to give them their share of its CPU time. */
+static __thread double thread_stages[PROFILE_STAGES][2];
+static __thread uint64_t thread_counters[PROFILE_COUNTERS];
+static __thread double thread_wall, thread_cpu;
+static __thread double thread_quick[PROFILE_STAGES];
+
+/* The run's totals, guarded by `lock` */
+static double run_stages[PROFILE_STAGES][2];
+static uint64_t run_counters[PROFILE_COUNTERS];
+static double run_start;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static double wall_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec*1e-9;
+}
+
+static double cpu_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return now.tv_sec + now.tv_nsec*1e-9;
+}
+
+void profile_start(profile_timer *timer) {
+    int i;
+
+    timer->wall = wall_now();
+    timer->cpu = cpu_now();
+    timer->nested_wall = thread_wall;
+    timer->nested_cpu = thread_cpu;
+    for (i = 0; i < PROFILE_STAGES; i++)
+        timer->quick[i] = thread_quick[i];
+}
+
+/* Charge the time since `timer` started, less stages timed inside it. The
+   CPU time left is split with the quick stages inside it by wall time. */
+void profile_stop(int stage, profile_timer *timer) {
+    double wall = wall_now() - timer->wall, cpu = cpu_now() - timer->cpu;
+    double own_wall = wall - (thread_wall - timer->nested_wall);
+    double own_cpu = cpu - (thread_cpu - timer->nested_cpu);
+    double quick[PROFILE_STAGES], quick_wall = 0;
+    int i;
+
+    for (i = 0; i < PROFILE_STAGES; i++) {
+        quick[i] = thread_quick[i] - timer->quick[i];
+        quick_wall += quick[i];
+        thread_quick[i] = timer->quick[i];
+    }
+    if (quick_wall > 0) {
+        for (i = 0; i < PROFILE_STAGES; i++)
+            thread_stages[i][1] += own_cpu*quick[i]/(own_wall + quick_wall);
+        own_cpu *= own_wall/(own_wall + quick_wall);
+    }
+    thread_stages[stage][0] += own_wall;
+    thread_stages[stage][1] += own_cpu;
+    thread_wall = timer->nested_wall + wall;
+    thread_cpu = timer->nested_cpu + cpu;
+}
+
+void profile_quick_start(profile_timer *timer) {
+    timer->wall = wall_now();
+}
+
+void profile_quick_stop(int stage, profile_timer *timer) {
+    double wall = wall_now() - timer->wall;
+
+    thread_stages[stage][0] += wall;
+    thread_quick[stage] += wall;
+    thread_wall += wall;
+}
+
+void profile_count(int counter, uint64_t n) {
+    thread_counters[counter] += n;
+}
+
+void profile_flush(void) {
+    int i;
+
+    if (!profile_enabled)
+        return;
+    pthread_mutex_lock(&lock);
+    for (i = 0; i < PROFILE_STAGES; i++) {
+        run_stages[i][0] += thread_stages[i][0];
+        run_stages[i][1] += thread_stages[i][1];
+        thread_stages[i][0] = thread_stages[i][1] = 0;
+    }
+    for (i = 0; i < PROFILE_COUNTERS; i++) {
+        run_counters[i] += thread_counters[i];
+        thread_counters[i] = 0;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+void profile_begin(void) {
+    run_start = wall_now();
+}
+
+void profile_write(FILE *out, const char *version) {
+    struct rusage usage;
+    long peak;
+    int i;
+
+    profile_flush();
+    getrusage(RUSAGE_SELF, &usage);
+    /* ru_maxrss is in bytes on macOS and KB elsewhere */
+#ifdef __APPLE__
+    peak = usage.ru_maxrss/1024;
+#else
+    peak = usage.ru_maxrss;
+#endif
+
+    pthread_mutex_lock(&lock);
+    fprintf(out, "{\n  \"version\": \"%s\",\n", version);
+    fprintf(out, "  \"wall_seconds\": %.6f,\n", wall_now() - run_start);
+    fprintf(out, "  \"cpu_seconds\": %.6f,\n",
+            usage.ru_utime.tv_sec + usage.ru_utime.tv_usec*1e-6 +
+            usage.ru_stime.tv_sec + usage.ru_stime.tv_usec*1e-6);
+    fprintf(out, "  \"peak_rss_kb\": %ld,\n", peak);
+    fprintf(out, "  \"stages\": {\n");
+    for (i = 0; i < PROFILE_STAGES; i++)
+        fprintf(out, "    \"%s\": {\"wall_seconds\": %.6f, \"cpu_seconds\": %.6f}%s\n", stage_names[i],
+                run_stages[i][0], run_stages[i][1], (i < PROFILE_STAGES - 1)?",":"");
+    fprintf(out, "  },\n");
+    for (i = 0; i < PROFILE_COUNTERS; i++)
+        fprintf(out, "  \"%s\": %llu%s\n", counter_names[i], (unsigned long long)run_counters[i],
+                (i < PROFILE_COUNTERS - 1)?",":"");
+    fprintf(out, "}\n");
+    fflush(out);
+    pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,67 @@
+#ifndef __PROFILE_H
+#define __PROFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Where a run spends its time, for `--profile`.
+
+   Each stage adds up the wall and CPU time of every thread while in it. A
+   stage timed inside another is only counted once, in the inner stage, so
+   the stages add up to the time spent. Totals are kept per thread and added
+   to the run's by profile_flush, which every thread calls before it ends.
+   Nothing is timed unless profile_enabled is set. */
+enum {
+    PROFILE_READ,      /* reading input files */
+    PROFILE_INFLATE,   /* gzip, BGZF and zstd decompression */
+    PROFILE_PARSE,     /* splitting records out of the stream */
+    PROFILE_WAIT,      /* the reading thread waiting for data or for workers */
+    PROFILE_TALLY,     /* counting reads */
+    PROFILE_TRANSFORM, /* turning counts into percentages */
+    PROFILE_RENDER,    /* drawing and writing the report */
+    PROFILE_STAGES
+};
+
+/* Counters */
+enum {
+    PROFILE_BYTES_COMPRESSED,   /* bytes read from input files */
+    PROFILE_BYTES_UNCOMPRESSED, /* bytes they decompressed to */
+    PROFILE_READS,
+    PROFILE_BASES,
+    PROFILE_ADAPTER_PROBES,     /* k-mers looked up in the adapter index */
+    PROFILE_ADAPTER_HITS,       /* reads an adapter was found in */
+    PROFILE_COUNTERS
+};
+
+extern int profile_enabled;
+
+typedef struct {
+    double wall, cpu;
+    double nested_wall, nested_cpu;
+    double quick[PROFILE_STAGES];
+} profile_timer;
+
+/* Time a stage: profile_start, then profile_stop with the stage. */
+void profile_start(profile_timer *timer);
+void profile_stop(int stage, profile_timer *timer);
+
+/* The same without reading the CPU clock, which is much slower than the wall
+   clock, for stages timed once per read. These must be inside a stage timed
+   with profile_start, and get the part of its CPU time that their share of
+   its wall time comes to. */
+void profile_quick_start(profile_timer *timer);
+void profile_quick_stop(int stage, profile_timer *timer);
+
+/* Add `n` to a counter */
+void profile_count(int counter, uint64_t n);
+
+/* Add this thread's totals to the run's */
+void profile_flush(void);
+
+/* Start the clock for the whole run */
+void profile_begin(void);
+
+/* Write the run's totals as JSON */
+void profile_write(FILE *out, const char *version);
+
+#endif
@@ -1,12 +1,22 @@
 #include <stdlib.h>
-#include <zlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <math.h>
 #include <limits.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 
+#include "checkpoint.h"
 #include "kseq.h"
+#include "mapped.h"
+#include "profile.h"
+#include "reader.h"
+#include "stats.h"
 #include "svg.h"
+#include "tally.h"
 
 #define unlikely(x) __builtin_expect ((x), 0)
 #define likely(x)       __builtin_expect((x),1)
@@ -22,7 +32,7 @@
                 svg_attr("text-anchor", "%s", "middle"),          \
                 svg_attr("transform", "rotate(%d)", rot)          \
                 );                                              \
-  printf("%s\n", label);                                        \
+  svg_printf("%s\n", label);                                    \
   svg_end_tag("text");
 #define svg_axis_number( posx, posy, a, number)                 \
   svg_start_tag("text", 6,                                      \
@@ -33,7 +43,7 @@
                 svg_attr("font-size",   "%s", "10px"),            \
                 svg_attr("text-anchor", "%s", a)                  \
                 );                                              \
-  printf("%d\n", number);                                       \
+  svg_printf("%d\n", number);                                   \
   svg_end_tag("text");
 
 #define svg_center_label( posx, posy, fillv, label_format, label)       \
@@ -46,38 +56,143 @@
                 svg_attr("font-weight", "%s", "bold"),                    \
                 svg_attr("text-anchor", "%s", "middle")                   \
                 );                                                      \
-  printf(label_format, label);                                          \
+  svg_printf(label_format, label);                                      \
   svg_end_tag("text");
 
 
 
+/* Most adapters drawn as their own line in the adapter panel */
+#define ADAPTER_LINES 4
+
+/* Which records of a file are tallied. The first `skip` records are passed
+   over, then each record is kept with probability `fraction`, decided by
+   hashing its number with `seed` so the same reads are picked every run and
+   with any number of threads. Reading stops once `max_reads` are kept. */
+typedef struct {
+    uint64_t skip, max_reads;
+    double fraction;
+    uint64_t seed;
+} read_sampling;
+
+/* What main writes to stdout */
+enum output_format { OUTPUT_SVG, OUTPUT_JSON, OUTPUT_TSV, OUTPUT_BINARY };
+
+/* Reading files that are still being written. Readers wait `follow` seconds
+   for a file to grow before taking its end as final, and with a `snapshot`
+   file, rewrite it with a report of the counts so far every `every_reads`
+   reads or `every_seconds` seconds, whichever comes first */
+typedef struct {
+    int follow;
+    char *snapshot;
+    uint64_t every_reads;
+    double every_seconds;
+    /* What the report holds, as for write_report */
+    enum output_format format;
+    char **files;
+    stats_info info;
+    char *name;
+    const char *note;
+    /* Latest counts of each file, guarded by `lock` */
+    sequence_data *latest[2];
+    /* With a `checkpoint` file, every `checkpoint_seconds` seconds the counts
+       of each file and where its reading has got to are saved there, so a
+       stopped run can be resumed. `positions` start where the checkpoint
+       found at start up left off, with its counts in `resumed` */
+    char *checkpoint;
+    double checkpoint_seconds;
+    checkpoint_settings settings;
+    sequence_data *resumed[2], *saved[2];
+    checkpoint_position positions[2];
+    pthread_mutex_t lock;
+} live_mode;
+
+void live_update(live_mode *live, int section, sequence_data *data);
+void live_checkpoint(live_mode *live, int section, sequence_data *data,
+                     const checkpoint_position *position);
+sequence_data* live_resumed(live_mode *live, int section, sequence_data *data);
+
 const char *program_version = "quack 1.1.1";
 struct arguments {
     char *name, *forward, *reverse, *unpaired, *adapters;
+    int threads, kmer_size;
+    enum output_format format;
+    read_sampling sampling;
+    int follow;
+    char *snapshot;
+    uint64_t snapshot_reads;
+    double snapshot_seconds;
+    char *checkpoint;
+    double checkpoint_seconds;
+    char *profile;
+    /* `merge` or `batch`, and the files that follow it. NULL otherwise */
+    char *command;
+    char **files;
+    int file_count;
 };
 
+void print_usage() {
+    printf("Usage: quack [OPTION...]\n"
+           "  or:  quack merge [OPTION...] FILE...\n"
+           "  or:  quack batch [OPTION...] MANIFEST\n"
+           "quack -- A FASTQ quality assessment tool\n\n"
+           "  -1, --forward file.1.fq.gz      Forward strand\n"
+           "  -2, --reverse file.2.fq.gz      Reverse strand\n"
+           "  -a, --adapters adapters.fa.gz   (Optional) Adapters file\n"
+           "  -n, --name NAME                 (Optional) Display in output\n"
+           "  -u, --unpaired unpaired.fq.gz   Data (only use with -u)\n"
+           "  -k, --kmer-size K               (Optional) Adapter k-mer size, 1 to 31 (default 10)\n"
+           "  -t, --threads N                 (Optional) Worker threads for reading files\n"
+           "  -m, --max-reads N               (Optional) Stop after N reads\n"
+           "  -s, --skip N                    (Optional) Pass over the first N reads\n"
+           "  -F, --fraction F                (Optional) Use a random fraction F (0 to 1) of the reads\n"
+           "  -S, --seed N                    (Optional) Seed for --fraction (default 1)\n"
+           "  -f, --format FORMAT             (Optional) svg (default), json or tsv for the raw counts,\n"
+           "                                  or binary for `quack merge`\n"
+           "  -p, --snapshot FILE             (Optional) Keep FILE updated with a report of the reads so far\n"
+           "  -r, --snapshot-reads N          (Optional) Update the snapshot every N reads\n"
+           "  -T, --snapshot-seconds T        (Optional) Update the snapshot every T seconds (default 10)\n"
+           "  -w, --follow T                  (Optional) Wait for growing files until idle for T seconds\n"
+           "  -c, --checkpoint FILE           (Optional) Save progress to FILE, and resume from it if it exists\n"
+           "  -C, --checkpoint-seconds T      (Optional) Save progress every T seconds (default 60)\n"
+           "  -P, --profile FILE              (Optional) Write where the time went as JSON to FILE, - for stderr\n"
+           "  -?, --help                      Give this help list\n"
+           "      --usage                     (use alone)\n"
+           "  -V, --version                   Print program version (use alone)\n\n"
+           "quack merge adds up the counts in binary files from `quack --format binary`\n"
+           "and writes them out like a single run, taking -n and -f.\n\n"
+           "quack batch reads many samples with one pool of -t threads (default: all\n"
+           "CPUs), taking -a, -k and -f. Each line of MANIFEST is a sample, as tab\n"
+           "separated name, output file and one (unpaired) or two (paired) FASTQ files.\n"
+           "Report bugs to <thrash@igbb.msstate.edu>.\n");
+}
+
 struct arguments parse_options(int argc, char **argv) {
   struct arguments arguments = {
                                 .unpaired = NULL,
                                 .forward = NULL,
                                 .reverse = NULL,
                                 .name = NULL,
-                                .adapters = NULL
+                                .adapters = NULL,
+                                .threads = 0,
+                                .kmer_size = 10,
+                                .format = OUTPUT_SVG,
+                                .sampling = {0, UINT64_MAX, 1, 1},
+                                .follow = 0,
+                                .snapshot = NULL,
+                                .snapshot_reads = 0,
+                                .snapshot_seconds = 0,
+                                .checkpoint = NULL,
+                                .checkpoint_seconds = 0,
+                                .profile = NULL,
+                                .command = NULL,
+                                .files = NULL,
+                                .file_count = 0
   };
+    int command = (argc > 1 && (strcmp(argv[1], "merge") == 0 || strcmp(argv[1], "batch") == 0));
 
     if (argc== 1 || argc == 2)  {
         if (argc == 1 || (strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "--usage") == 0 || strcmp(argv[1], "-?") == 0)) {
-            printf("Usage: quack [OPTION...]\n"
-            "quack -- A FASTQ quality assessment tool\n\n"
-            "  -1, --forward file.1.fq.gz      Forward strand\n"
-            "  -2, --reverse file.2.fq.gz      Reverse strand\n"
-            "  -a, --adapters adapters.fa.gz   (Optional) Adapters file\n"
-            "  -n, --name NAME                 (Optional) Display in output\n"
-            "  -u, --unpaired unpaired.fq.gz   Data (only use with -u)\n"
-            "  -?, --help                      Give this help list\n"
-            "      --usage                     (use alone)\n"
-            "  -V, --version                   Print program version (use alone)\n"
-            "Report bugs to <thrash@igbb.msstate.edu>.\n");
+            print_usage();
         }
 
         if (argc == 2 && ((strcmp(argv[1], "-V") == 0 || strcmp(argv[1], "--version") == 0))) {
@@ -86,10 +201,24 @@ struct arguments parse_options(int argc, char **argv) {
         }
     }
 
-    if(argc>2 && argc % 2 != 0)
+    /* Options come in pairs. `quack merge` and `quack batch` also take files */
+    if(command){
+        arguments.command = argv[1];
+        arguments.files = malloc(argc*sizeof(char*));
+    }
+    if(command || (argc>2 && argc % 2 != 0))
     {
-        int counter=1;
+        int counter=(command)?2:1;
         while (counter<argc) {
+            if (command && argv[counter][0] != '-') {
+                arguments.files[arguments.file_count++] = argv[counter++];
+                continue;
+            }
+            if (counter+1 == argc) {
+                print_usage();
+                exit(1);
+            }
+
             if (strcmp(argv[counter], "--forward") == 0 || strcmp(argv[counter], "-1") == 0) {
                 arguments.forward = argv[counter+1];
             }
@@ -109,129 +238,841 @@ struct arguments parse_options(int argc, char **argv) {
             else if (strcmp(argv[counter], "--name") == 0 || strcmp(argv[counter], "-n") == 0) {
                 arguments.name = argv[counter+1];
             }
+
+            else if (strcmp(argv[counter], "--threads") == 0 || strcmp(argv[counter], "-t") == 0) {
+                arguments.threads = atoi(argv[counter+1]);
+                if (arguments.threads < 1)
+                    arguments.threads = 1;
+            }
+
+            else if (strcmp(argv[counter], "--kmer-size") == 0 || strcmp(argv[counter], "-k") == 0) {
+                arguments.kmer_size = atoi(argv[counter+1]);
+                if (arguments.kmer_size < 1 || arguments.kmer_size > KMER_MAX_SIZE) {
+                    fprintf(stderr, "quack: --kmer-size must be between 1 and %d\n", KMER_MAX_SIZE);
+                    exit(1);
+                }
+            }
+
+            else if (strcmp(argv[counter], "--max-reads") == 0 || strcmp(argv[counter], "-m") == 0) {
+                arguments.sampling.max_reads = strtoull(argv[counter+1], NULL, 10);
+            }
+
+            else if (strcmp(argv[counter], "--skip") == 0 || strcmp(argv[counter], "-s") == 0) {
+                arguments.sampling.skip = strtoull(argv[counter+1], NULL, 10);
+            }
+
+            else if (strcmp(argv[counter], "--fraction") == 0 || strcmp(argv[counter], "-F") == 0) {
+                arguments.sampling.fraction = atof(argv[counter+1]);
+                if (!(arguments.sampling.fraction > 0 && arguments.sampling.fraction <= 1)) {
+                    fprintf(stderr, "quack: --fraction must be more than 0 and at most 1\n");
+                    exit(1);
+                }
+            }
+
+            else if (strcmp(argv[counter], "--seed") == 0 || strcmp(argv[counter], "-S") == 0) {
+                arguments.sampling.seed = strtoull(argv[counter+1], NULL, 10);
+            }
+
+            else if (strcmp(argv[counter], "--snapshot") == 0 || strcmp(argv[counter], "-p") == 0) {
+                arguments.snapshot = argv[counter+1];
+            }
+
+            else if (strcmp(argv[counter], "--snapshot-reads") == 0 || strcmp(argv[counter], "-r") == 0) {
+                arguments.snapshot_reads = strtoull(argv[counter+1], NULL, 10);
+            }
+
+            else if (strcmp(argv[counter], "--snapshot-seconds") == 0 || strcmp(argv[counter], "-T") == 0) {
+                arguments.snapshot_seconds = atof(argv[counter+1]);
+            }
+
+            else if (strcmp(argv[counter], "--checkpoint") == 0 || strcmp(argv[counter], "-c") == 0) {
+                arguments.checkpoint = argv[counter+1];
+            }
+
+            else if (strcmp(argv[counter], "--checkpoint-seconds") == 0 || strcmp(argv[counter], "-C") == 0) {
+                arguments.checkpoint_seconds = atof(argv[counter+1]);
+            }
+
+            else if (strcmp(argv[counter], "--profile") == 0 || strcmp(argv[counter], "-P") == 0) {
+                arguments.profile = argv[counter+1];
+            }
+
+            else if (strcmp(argv[counter], "--follow") == 0 || strcmp(argv[counter], "-w") == 0) {
+                arguments.follow = atoi(argv[counter+1]);
+                if (arguments.follow < 0)
+                    arguments.follow = 0;
+            }
+
+            else if (strcmp(argv[counter], "--format") == 0 || strcmp(argv[counter], "-f") == 0) {
+                if (strcmp(argv[counter+1], "svg") == 0)
+                    arguments.format = OUTPUT_SVG;
+                else if (strcmp(argv[counter+1], "json") == 0)
+                    arguments.format = OUTPUT_JSON;
+                else if (strcmp(argv[counter+1], "tsv") == 0)
+                    arguments.format = OUTPUT_TSV;
+                else if (strcmp(argv[counter+1], "binary") == 0)
+                    arguments.format = OUTPUT_BINARY;
+                else {
+                    fprintf(stderr, "quack: --format must be svg, json, tsv or binary\n");
+                    exit(1);
+                }
+            }
             else {
-                printf("Usage: quack [OPTION...]\n"
-                "quack -- A FASTQ quality assessment tool\n\n"
-                "  -1, --forward file.1.fq.gz      Forward strand\n"
-                "  -2, --reverse file.2.fq.gz      Reverse strand\n"
-                "  -a, --adapters adapters.fa.gz    Adapters file\n"
-                "  -n, --name NAME            Display in output\n"
-                "  -u, --unpaired unpaired.fq.gz        Data (only use with -u)\n"
-                "  -?, --help                 Give this help list\n"
-                "      --usage                (use alone)\n"
-                "  -V, --version              Print program version (use alone)\n"
-                "Report bugs to <thrash@igbb.msstate.edu>.\n");
+                print_usage();
             }
 
             counter = counter+2;
         }
     }
+
+    if (arguments.snapshot == NULL && (arguments.snapshot_reads > 0 || arguments.snapshot_seconds > 0)) {
+        fprintf(stderr, "quack: --snapshot-reads and --snapshot-seconds need --snapshot FILE\n");
+        exit(1);
+    }
+    if (arguments.snapshot != NULL && arguments.snapshot_reads == 0 && arguments.snapshot_seconds <= 0)
+        arguments.snapshot_seconds = 10;
+    if (arguments.checkpoint == NULL && arguments.checkpoint_seconds > 0) {
+        fprintf(stderr, "quack: --checkpoint-seconds needs --checkpoint FILE\n");
+        exit(1);
+    }
+    if (arguments.checkpoint_seconds <= 0)
+        arguments.checkpoint_seconds = 60;
     return arguments;
 }
 
-typedef struct {
-    uint64_t scores[91];
-    uint64_t content[4];
-    uint64_t length_count;
-    uint64_t kmer_count;
-} base_information;
+KSEQ_INIT(input_stream*, input_read)
 
-typedef struct {
-    base_information *bases;
-    uint64_t max_length;
-    uint64_t original_max_length;
-    uint64_t number_of_sequences;
-} sequence_data;
-
-/* Convert ASCII to Integer for A T C and G */
-/*                A     C           G                                      T */
-int lookup[20] = {0, 0, 2, 0, 0, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1};
-
-KSEQ_INIT(gzFile, gzread)
-
-int* read_adapters(char *adapters_file) {
-    int kmer_size = 10;
-    int array_size = pow(4, kmer_size);
-    gzFile fp;
+input_stream* open_or_exit(char *file, int threads, int follow) {
+    input_stream *fp = input_open(file, threads, follow);
+    if (fp == NULL) {
+        fprintf(stderr, "quack: cannot open %s\n", file);
+        exit(1);
+    }
+    return fp;
+}
+
+kmer_index* read_adapters(char *adapters_file, int kmer_size) {
+    input_stream *fp;
     kseq_t *seq;
-    int i, l, index;
-    fp = gzopen(adapters_file, "r");
+    int l;
+    kmer_index *kmers = kmer_index_init(kmer_size);
+    fp = open_or_exit(adapters_file, 1, 0);
     seq = kseq_init(fp);
-    int *kmers = malloc(array_size*sizeof(int));
-    memset(kmers, 0, array_size*sizeof(int));
     while ((l = kseq_read(seq)) >= 0) {
-        index = 0;
-            for (i = 0; i < kmer_size; i++) {
-                index = ((index << 2) + (lookup[seq->seq.s[i]-65 & ~32])) & (array_size-1);
+        kmer_index_add(kmers, seq->name.s, seq->seq.s, seq->seq.l);
+    }
+    kseq_destroy(seq);
+    input_close(fp);
+    return kmers;
+}
+
+/*************** Threaded ingest ***************/
+
+/* Records are handed from the parsing thread to the workers in batches to keep
+   queue traffic low. Sequence and quality of each record are stored back to
+   back in `data`. Batches are numbered in file order, and `hashes` keeps the
+   duplication hash of each record for the overrepresented sequences. */
+#define BATCH_RECORDS 4096
+#define BATCH_BYTES   (1 << 20)
+
+typedef struct {
+    char *data;
+    size_t used, capacity;
+    size_t offsets[BATCH_RECORDS];
+    uint64_t lengths[BATCH_RECORDS];
+    uint64_t hashes[BATCH_RECORDS];
+    uint64_t number;
+    int count;
+} read_batch;
+
+/* Blocking FIFO of batch pointers */
+typedef struct {
+    read_batch **slots;
+    int size, head, count;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty, not_full;
+} batch_queue;
+
+void batch_queue_init(batch_queue *queue, int size) {
+    queue->slots = malloc(size*sizeof(read_batch*));
+    queue->size = size;
+    queue->head = queue->count = 0;
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->not_empty, NULL);
+    pthread_cond_init(&queue->not_full, NULL);
+}
+
+void batch_queue_destroy(batch_queue *queue) {
+    free(queue->slots);
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_cond_destroy(&queue->not_full);
+}
+
+void batch_queue_push(batch_queue *queue, read_batch *batch) {
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == queue->size)
+        pthread_cond_wait(&queue->not_full, &queue->lock);
+    queue->slots[(queue->head + queue->count) % queue->size] = batch;
+    queue->count++;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+read_batch* batch_queue_pop(batch_queue *queue) {
+    read_batch *batch;
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0)
+        pthread_cond_wait(&queue->not_empty, &queue->lock);
+    batch = queue->slots[queue->head];
+    queue->head = (queue->head + 1) % queue->size;
+    queue->count--;
+    pthread_cond_signal(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+    return batch;
+}
+
+/* Copy the current record into the batch, return 1 if the batch is full */
+int batch_add(read_batch *batch, kseq_t *seq) {
+    size_t needed = batch->used + 2*seq->seq.l;
+    if (unlikely(needed > batch->capacity)) {
+        batch->capacity = (needed > 2*batch->capacity)?needed:2*batch->capacity;
+        batch->data = realloc(batch->data, batch->capacity);
+    }
+    memcpy(batch->data + batch->used, seq->seq.s, seq->seq.l);
+    memcpy(batch->data + batch->used + seq->seq.l, seq->qual.s, seq->seq.l);
+    batch->offsets[batch->count] = batch->used;
+    batch->lengths[batch->count] = seq->seq.l;
+    batch->used = needed;
+    batch->count++;
+    return batch->count == BATCH_RECORDS || batch->used >= BATCH_BYTES;
+}
+
+/* The overrepresented sequences of a threaded run. Space-Saving depends on
+   the order reads come in, so workers don't keep summaries of their own; each
+   adds its reads here once every batch before its own is in, with batches
+   numbered from 0 in file order. The summary then comes out as a single pass
+   would have it, whatever the number of threads or which worker took which
+   batch. */
+typedef struct {
+    overrepresented_summary summary;
+    uint64_t next;
+    pthread_mutex_t lock;
+    pthread_cond_t turn;
+} ordered_summary;
+
+void ordered_summary_init(ordered_summary *ordered) {
+    memset(&ordered->summary, 0, sizeof(overrepresented_summary));
+    ordered->next = 0;
+    pthread_mutex_init(&ordered->lock, NULL);
+    pthread_cond_init(&ordered->turn, NULL);
+}
+
+void ordered_summary_destroy(ordered_summary *ordered) {
+    overrepresented_free(&ordered->summary);
+    pthread_mutex_destroy(&ordered->lock);
+    pthread_cond_destroy(&ordered->turn);
+}
+
+/* Wait until batch `number` is next. The summary is then the caller's until
+   it calls ordered_summary_done */
+void ordered_summary_wait(ordered_summary *ordered, uint64_t number) {
+    pthread_mutex_lock(&ordered->lock);
+    while (ordered->next != number)
+        pthread_cond_wait(&ordered->turn, &ordered->lock);
+    pthread_mutex_unlock(&ordered->lock);
+}
+
+void ordered_summary_done(ordered_summary *ordered) {
+    pthread_mutex_lock(&ordered->lock);
+    ordered->next++;
+    pthread_cond_broadcast(&ordered->turn);
+    pthread_mutex_unlock(&ordered->lock);
+}
+
+/* Snapshots of the worker tallies. The parsing thread queues one marker per
+   worker; a worker taking one adds its counts to `tally` and waits for the
+   next `round`, so no worker takes two */
+typedef struct {
+    read_tally tally;
+    int pending, round;
+    pthread_mutex_t lock;
+    pthread_cond_t taken, resume;
+} tally_snapshot;
+
+static read_batch snapshot_marker;
+
+typedef struct {
+    batch_queue *filled, *empty;
+    kmer_index *kmers;
+    read_tally tally;
+    tally_snapshot *snapshot;
+    ordered_summary *ordered;
+} tally_worker;
+
+/* Worker loop: tally batches until the NULL sentinel arrives */
+void* tally_worker_run(void *arg) {
+    tally_worker *worker = arg;
+    tally_snapshot *snapshot = worker->snapshot;
+    read_batch *batch;
+    profile_timer timer;
+    int i, round;
+
+    while ((batch = batch_queue_pop(worker->filled)) != NULL) {
+        if (batch == &snapshot_marker) {
+            pthread_mutex_lock(&snapshot->lock);
+            tally_merge(&snapshot->tally, &worker->tally);
+            round = snapshot->round;
+            if (--snapshot->pending == 0)
+                pthread_cond_signal(&snapshot->taken);
+            while (snapshot->round == round)
+                pthread_cond_wait(&snapshot->resume, &snapshot->lock);
+            pthread_mutex_unlock(&snapshot->lock);
+            continue;
+        }
+        if (profile_enabled) profile_start(&timer);
+        for (i = 0; i < batch->count; i++) {
+            char *record = batch->data + batch->offsets[i];
+            tally_read(&worker->tally, record, record + batch->lengths[i],
+                       batch->lengths[i], worker->kmers);
+            batch->hashes[i] = worker->tally.last_hash;
+        }
+        if (profile_enabled) profile_stop(PROFILE_TALLY, &timer);
+
+        ordered_summary_wait(worker->ordered, batch->number);
+        if (profile_enabled) profile_start(&timer);
+        for (i = 0; i < batch->count; i++)
+            overrepresented_add(&worker->ordered->summary, batch->hashes[i],
+                                batch->data + batch->offsets[i], batch->lengths[i]);
+        if (profile_enabled) profile_stop(PROFILE_TALLY, &timer);
+        ordered_summary_done(worker->ordered);
+        batch->used = batch->count = 0;
+        batch_queue_push(worker->empty, batch);
+    }
+    profile_flush();
+    return NULL;
+}
+
+static inline int sample_read(const read_sampling *sampling, uint64_t index) {
+    uint64_t x;
+
+    if (index < sampling->skip)
+        return 0;
+    if (sampling->fraction >= 1)
+        return 1;
+
+    /* splitmix64 of the record number, compared as a 53-bit fraction */
+    x = sampling->seed + (index + 1)*0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30))*0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27))*0x94D049BB133111EBULL;
+    x = x ^ (x >> 31);
+    return (x >> 11)*0x1.0p-53 < sampling->fraction;
+}
+
+/* Describe `sampling` for the report, empty if every read was used */
+void sampling_note(const read_sampling *sampling, char *note, size_t length) {
+    int n = 0;
+
+    note[0] = '\0';
+    if (sampling->skip > 0)
+        n += snprintf(note + n, length - n, "skipped %" PRIu64, sampling->skip);
+    if (sampling->max_reads != UINT64_MAX && (size_t)n < length)
+        n += snprintf(note + n, length - n, "%sat most %" PRIu64 " reads", (n > 0)?", ":"",
+                      sampling->max_reads);
+    if (sampling->fraction < 1 && (size_t)n < length)
+        n += snprintf(note + n, length - n, "%s%g%% sample, seed %" PRIu64, (n > 0)?", ":"",
+                      100*sampling->fraction, sampling->seed);
+}
+
+/* Threaded runs cut a mapped file every MAPPED_CHUNK bytes, at the next
+   record, and deal the chunks out to the threads in turn */
+#define MAPPED_CHUNK (1 << 22)
+
+/* A read of a chunk waiting for its turn in the overrepresented summary */
+typedef struct {
+    uint64_t hash;
+    const char *seq;
+    uint64_t length;
+} mapped_read;
+
+/* The chunks of a mapped file one thread tallies, `first`, `first + step`
+   and so on of the `chunks` between `bounds`, and the tally of their reads.
+   With `ordered`, each chunk's reads are kept in `reads` until it is their
+   turn to be added to it. */
+typedef struct {
+    const mapped_file *file;
+    const size_t *bounds;
+    uint64_t first, chunks;
+    int step;
+    kmer_index *kmers;
+    const read_sampling *sampling;
+    read_tally tally;
+    ordered_summary *ordered;
+    mapped_read *reads;
+    uint64_t capacity;
+    int error;
+} mapped_range;
+
+void* mapped_range_run(void *arg) {
+    mapped_range *range = arg;
+    mapped_record record;
+    size_t pos;
+    uint64_t c, i, n, index = 0, kept = 0;
+    profile_timer timer, read_timer;
+    int r = 1;
+
+    if (profile_enabled) profile_start(&timer);
+    for (c = range->first; c < range->chunks; c += range->step) {
+        pos = range->bounds[c];
+        n = 0;
+        while (!range->error && kept < range->sampling->max_reads &&
+               (r = mapped_next(range->file, &pos, range->bounds[c+1], &record)) > 0) {
+            if (!sample_read(range->sampling, index++))
+                continue;
+            kept++;
+            if (unlikely(profile_enabled)) profile_quick_start(&read_timer);
+            tally_read(&range->tally, record.seq, record.qual, record.length, range->kmers);
+            if (unlikely(profile_enabled)) profile_quick_stop(PROFILE_TALLY, &read_timer);
+            if (range->ordered != NULL) {
+                if (n == range->capacity) {
+                    range->capacity = (n > 0)?2*n:4096;
+                    range->reads = realloc(range->reads, range->capacity*sizeof(mapped_read));
+                }
+                range->reads[n].hash = range->tally.last_hash;
+                range->reads[n].seq = record.seq;
+                range->reads[n].length = record.length;
+                n++;
             }
-        for (; i < seq->seq.l; i++) {
-            index = ((index << 2) + (lookup[seq->seq.s[i]-65 & ~32])) & (array_size-1);
-            kmers[index] = 1;
         }
+        /* The last record must end exactly where the next chunk starts */
+        range->error |= (r < 0 || (r == 0 && pos != range->bounds[c+1]));
+
+        if (range->ordered != NULL) {
+            ordered_summary_wait(range->ordered, c);
+            for (i = 0; i < n; i++)
+                overrepresented_add(&range->ordered->summary, range->reads[i].hash,
+                                    range->reads[i].seq, range->reads[i].length);
+            ordered_summary_done(range->ordered);
+        }
+    }
+    if (profile_enabled) profile_stop(PROFILE_PARSE, &timer);
+    profile_flush();
+    return NULL;
+}
 
+/* Tally a mapped file in place, in chunks tallied by `threads` threads in
+   parallel. Reads are numbered from the start of the file, so a sampled run
+   is a single chunk. Returns -1, leaving `tally` untouched, if the file is
+   not four line FASTQ. */
+int tally_mapped(const mapped_file *file, kmer_index *kmers, int threads,
+                 const read_sampling *sampling, read_tally *tally) {
+    int i, error = 0;
+    int number_of_ranges = (sampling->skip == 0 && sampling->max_reads == UINT64_MAX &&
+                            sampling->fraction >= 1 && threads > 1)?threads:1;
+    uint64_t c, chunks = (number_of_ranges > 1)?(file->length - 1)/MAPPED_CHUNK + 1:1;
+    size_t *bounds = malloc((chunks + 1)*sizeof(size_t));
+    mapped_range *ranges;
+    pthread_t *ids;
+    ordered_summary ordered;
+
+    bounds[0] = 0;
+    bounds[chunks] = file->length;
+    for (c = 1; c < chunks; c++) {
+        bounds[c] = mapped_record_start(file, c*MAPPED_CHUNK);
+        if (bounds[c] < bounds[c-1])
+            bounds[c] = bounds[c-1];
     }
-    kseq_destroy(seq);
-    gzclose(fp);
-    return kmers;
+    if ((uint64_t)number_of_ranges > chunks)
+        number_of_ranges = chunks;
+    ranges = calloc(number_of_ranges, sizeof(mapped_range));
+    ids = malloc(number_of_ranges*sizeof(pthread_t));
+    if (number_of_ranges > 1)
+        ordered_summary_init(&ordered);
+
+    for (i = 0; i < number_of_ranges; i++) {
+        ranges[i].file = file;
+        ranges[i].bounds = bounds;
+        ranges[i].first = i;
+        ranges[i].chunks = chunks;
+        ranges[i].step = number_of_ranges;
+        ranges[i].kmers = kmers;
+        ranges[i].sampling = sampling;
+        tally_init(&ranges[i].tally);
+        if (number_of_ranges > 1) {
+            ranges[i].ordered = &ordered;
+            ranges[i].tally.ordered = 1;
+        }
+    }
+
+    if (number_of_ranges == 1) {
+        mapped_range_run(&ranges[0]);
+    } else {
+        for (i = 0; i < number_of_ranges; i++)
+            pthread_create(&ids[i], NULL, mapped_range_run, &ranges[i]);
+        for (i = 0; i < number_of_ranges; i++)
+            pthread_join(ids[i], NULL);
+    }
+
+    for (i = 0; i < number_of_ranges; i++)
+        error |= ranges[i].error;
+    for (i = 0; i < number_of_ranges; i++) {
+        if (!error)
+            tally_merge(tally, &ranges[i].tally);
+        tally_free(&ranges[i].tally);
+        free(ranges[i].tally.bases);
+        free(ranges[i].tally.adapter_hits);
+        duplication_free(&ranges[i].tally.duplication);
+        overrepresented_free(&ranges[i].tally.overrepresented);
+        free(ranges[i].reads);
+    }
+    if (number_of_ranges > 1) {
+        if (!error)
+            overrepresented_merge(&tally->overrepresented, &ordered.summary);
+        ordered_summary_destroy(&ordered);
+    }
+    free(bounds);
+    free(ranges);
+    free(ids);
+    return error?-1:0;
 }
 
-sequence_data* read_fastq(char *fastq_file, int *kmers) {
-    gzFile fp;
-    kseq_t *seq;
-    int i, l, index;
-    int kmer_size = 10;
-    int array_size = pow(4, kmer_size);
-    int max_length = 0;
-    fp = gzopen(fastq_file, "r");
-    seq = kseq_init(fp);
-    base_information *bases = NULL;
-    sequence_data *to_return = malloc(sizeof(sequence_data));
-    int number_of_sequences = 0;
+/* Turn a tally into the counts of one file, taking over its totals */
+sequence_data* tally_data(read_tally *tally, kmer_index *kmers) {
+    sequence_data *data = malloc(sizeof(sequence_data));
+
+    tally_flush(tally);
+    tally_free(tally);
+    data->bases = tally->bases;
+    /* Every adapter gets its counters, even if it was never found */
+    data->adapters = (kmers != NULL)?kmers->adapters:0;
+    data->adapter_names = (kmers != NULL)?kmers->names:NULL;
+    data->adapter_hits = tally->adapter_hits;
+    if (data->adapter_hits == NULL && data->adapters > 0)
+        data->adapter_hits = calloc(tally->max_length*data->adapters, sizeof(uint64_t));
+    data->max_length = tally->max_length;
+    data->number_of_sequences = tally->number_of_sequences;
+    memcpy(data->gc, tally->gc, sizeof(data->gc));
+    memcpy(data->mean_quality, tally->mean_quality, sizeof(data->mean_quality));
+    data->duplication = tally->duplication;
+    data->overrepresented = tally->overrepresented;
+    return data;
+}
 
-    while ((l = kseq_read(seq)) >= 0) {
-        if (unlikely(seq->seq.l > max_length)) {
-            bases = realloc(bases, seq->seq.l*sizeof(base_information));
-            memset(bases+max_length, 0, (seq->seq.l - max_length)*sizeof(base_information));
-            max_length = seq->seq.l;
+/* When a reader last took a snapshot */
+typedef struct {
+    uint64_t reads;
+    double time;
+} snapshot_clock;
+
+static double seconds_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec*1e-9;
+}
+
+/* Whether a snapshot, taken every `every_reads` reads or `every_seconds`
+   seconds, is due after `kept` reads. The clock is only read every 64 reads
+   to keep it off the per-read path */
+static int snapshot_due(uint64_t every_reads, double every_seconds, snapshot_clock *clock,
+                        uint64_t kept) {
+    double now;
+
+    if (every_reads > 0 && kept - clock->reads >= every_reads) {
+        clock->reads = kept;
+        clock->time = seconds_now();
+        return 1;
+    }
+    if (every_seconds > 0 && (kept & 63) == 0 &&
+        (now = seconds_now()) - clock->time >= every_seconds) {
+        clock->reads = kept;
+        clock->time = now;
+        return 1;
+    }
+    return 0;
+}
+
+/* Collect the counts of every worker so far. The markers queue up behind
+   the batches already filled, and each worker finishes the batch it is on
+   before taking one, so every queued batch is counted, and is in `ordered` */
+sequence_data* snapshot_workers(tally_snapshot *snapshot, batch_queue *filled, int threads,
+                                ordered_summary *ordered, kmer_index *kmers) {
+    int i;
+
+    pthread_mutex_lock(&snapshot->lock);
+    snapshot->pending = threads;
+    pthread_mutex_unlock(&snapshot->lock);
+    for (i = 0; i < threads; i++)
+        batch_queue_push(filled, &snapshot_marker);
+
+    pthread_mutex_lock(&snapshot->lock);
+    while (snapshot->pending > 0)
+        pthread_cond_wait(&snapshot->taken, &snapshot->lock);
+    overrepresented_merge(&snapshot->tally.overrepresented, &ordered->summary);
+    snapshot->round++;
+    pthread_cond_broadcast(&snapshot->resume);
+    pthread_mutex_unlock(&snapshot->lock);
+
+    /* Workers don't touch the snapshot again until the next one */
+    return tally_data(&snapshot->tally, kmers);
+}
+
+/* Where the record after the one just read starts, `index` records into
+   the file with `kept` of them tallied. Returns 0 if the stream can't be
+   restarted there */
+static int stream_position(input_stream *fp, kseq_t *seq, uint64_t index, uint64_t kept,
+                           checkpoint_position *position) {
+    kstream_t *ks = seq->f;
+
+    /* After a FASTQ record kseq has not looked at the next one, so only
+       what it has buffered is left to parse */
+    if (seq->last_char != 0)
+        return 0;
+    position->offset = input_tell(fp) - ((ks->begin < ks->end)?ks->end - ks->begin:0);
+    position->index = index;
+    position->kept = kept;
+    position->done = 0;
+    return input_restart_point(fp, position->offset, &position->point);
+}
+
+/* Tally a file through kseq, decompressing it if need be. With `live`, the
+   file is followed, snapshots of `section` are taken and checkpoints kept as
+   it goes */
+void tally_stream(char *fastq_file, kmer_index *kmers, int threads,
+                  const read_sampling *sampling, live_mode *live, int section,
+                  read_tally *tally) {
+    input_stream *fp;
+    kseq_t *seq;
+    int i, l;
+    uint64_t index = 0, kept = 0;
+    snapshot_clock clock = {0, seconds_now()}, saved = clock;
+    int snapshots = (live != NULL && live->snapshot != NULL);
+    int checkpoints = (live != NULL && live->checkpoint != NULL);
+    checkpoint_position *position = NULL;
+    profile_timer timer, read_timer;
+
+    if (checkpoints) {
+        /* Carry on from the checkpoint, unless it had read the whole file */
+        const checkpoint_position *start = &live->positions[section];
+        if (start->done)
+            return;
+        index = start->index;
+        kept = start->kept;
+        fp = input_open_resumable(fastq_file, threads, live->follow,
+                                  (start->offset > 0)?&start->point:NULL, start->offset);
+        if (fp == NULL) {
+            fprintf(stderr, "quack: cannot open %s\n", fastq_file);
+            exit(1);
         }
-        for (i = 0; i < seq->seq.l; i++) {
-            int base = seq->seq.s[i];
-            int offset = lookup[base-65 & ~32];
-            bases[i].content[offset]++;
-            int quality = seq->qual.s[i]-33;
-            bases[i].scores[quality]++;
+        position = malloc(sizeof(checkpoint_position));
+    } else {
+        fp = open_or_exit(fastq_file, threads, (live != NULL)?live->follow:0);
+    }
+    seq = kseq_init(fp);
+    if (profile_enabled) profile_start(&timer);
+
+    /* Records are picked here, in file order, and reading stops as soon as
+       the quota is met */
+    if (threads <= 1) {
+        while (kept < sampling->max_reads && (l = kseq_read(seq)) >= 0) {
+            if (!sample_read(sampling, index++))
+                continue;
+            kept++;
+            if (unlikely(profile_enabled)) profile_quick_start(&read_timer);
+            tally_read(tally, seq->seq.s, seq->qual.s, seq->seq.l, kmers);
+            if (unlikely(profile_enabled)) profile_quick_stop(PROFILE_TALLY, &read_timer);
+
+            if (unlikely(snapshots) && snapshot_due(live->every_reads, live->every_seconds, &clock, kept)) {
+                read_tally copy;
+                tally_init(&copy);
+                tally_merge(&copy, tally);
+                live_update(live, section, live_resumed(live, section, tally_data(&copy, kmers)));
+            }
+            if (unlikely(checkpoints) && snapshot_due(0, live->checkpoint_seconds, &saved, kept) &&
+                stream_position(fp, seq, index, kept, position)) {
+                read_tally copy;
+                tally_init(&copy);
+                tally_merge(&copy, tally);
+                live_checkpoint(live, section, live_resumed(live, section, tally_data(&copy, kmers)),
+                                position);
+            }
         }
-        index = 0;
-        for (i = 0; i < kmer_size; i++) {
-            index = ((index << 2) + (lookup[seq->seq.s[i]-65 & ~32])) & (array_size-1);
+    } else {
+        /* This thread parses and fills batches; `threads` workers tally them.
+           Two batches per worker keeps everyone busy while one is refilled */
+        int number_of_batches = 2*threads;
+        batch_queue filled, empty;
+        read_batch *batches = calloc(number_of_batches, sizeof(read_batch));
+        read_batch *current;
+        tally_worker *workers = calloc(threads, sizeof(tally_worker));
+        pthread_t *ids = malloc(threads*sizeof(pthread_t));
+        tally_snapshot snapshot;
+        ordered_summary ordered;
+        uint64_t number = 0;
+
+        tally_init(&snapshot.tally);
+        ordered_summary_init(&ordered);
+        snapshot.pending = snapshot.round = 0;
+        pthread_mutex_init(&snapshot.lock, NULL);
+        pthread_cond_init(&snapshot.taken, NULL);
+        pthread_cond_init(&snapshot.resume, NULL);
+
+        /* `filled` must also hold one sentinel, or snapshot marker, per
+           worker */
+        batch_queue_init(&filled, number_of_batches + threads);
+        batch_queue_init(&empty, number_of_batches);
+        for (i = 0; i < number_of_batches; i++)
+            batch_queue_push(&empty, &batches[i]);
+
+        for (i = 0; i < threads; i++) {
+            workers[i].filled = &filled;
+            workers[i].empty = &empty;
+            workers[i].kmers = kmers;
+            workers[i].snapshot = &snapshot;
+            workers[i].ordered = &ordered;
+            tally_init(&workers[i].tally);
+            workers[i].tally.ordered = 1;
+            pthread_create(&ids[i], NULL, tally_worker_run, &workers[i]);
         }
-        if (kmers) {
-            for (; kmers[index] == 0 && i < seq->seq.l; i++) {
-                index = ((index << 2) + (lookup[seq->seq.s[i]-65 & ~32])) & (array_size-1);
+
+        current = batch_queue_pop(&empty);
+        while (kept < sampling->max_reads && (l = kseq_read(seq)) >= 0) {
+            if (!sample_read(sampling, index++))
+                continue;
+            kept++;
+            if (batch_add(current, seq)) {
+                if (profile_enabled) profile_start(&read_timer);
+                current->number = number++;
+                batch_queue_push(&filled, current);
+                current = batch_queue_pop(&empty);
+                if (profile_enabled) profile_stop(PROFILE_WAIT, &read_timer);
+            }
+
+            if (unlikely(snapshots) && snapshot_due(live->every_reads, live->every_seconds, &clock, kept)) {
+                live_update(live, section, live_resumed(live, section,
+                                                        snapshot_workers(&snapshot, &filled, threads, &ordered, kmers)));
+                tally_init(&snapshot.tally);
+            }
+            /* A checkpoint needs every read so far, including those in the
+               batch being filled */
+            if (unlikely(checkpoints) && snapshot_due(0, live->checkpoint_seconds, &saved, kept) &&
+                stream_position(fp, seq, index, kept, position)) {
+                if (current->count > 0) {
+                    current->number = number++;
+                    batch_queue_push(&filled, current);
+                    current = batch_queue_pop(&empty);
+                }
+                live_checkpoint(live, section, live_resumed(live, section,
+                                                            snapshot_workers(&snapshot, &filled, threads, &ordered, kmers)),
+                                position);
+                tally_init(&snapshot.tally);
             }
         }
-        if (i < seq->seq.l) {
-            bases[i].kmer_count++;
+        if (current->count > 0) {
+            current->number = number++;
+            batch_queue_push(&filled, current);
         }
 
-        bases[seq->seq.l-1].length_count++;
-        number_of_sequences++;
+        for (i = 0; i < threads; i++)
+            batch_queue_push(&filled, NULL);
+        if (profile_enabled) profile_start(&read_timer);
+        for (i = 0; i < threads; i++)
+            pthread_join(ids[i], NULL);
+        if (profile_enabled) profile_stop(PROFILE_WAIT, &read_timer);
+        for (i = 0; i < threads; i++) {
+            tally_merge(tally, &workers[i].tally);
+            tally_free(&workers[i].tally);
+            free(workers[i].tally.bases);
+            free(workers[i].tally.adapter_hits);
+            duplication_free(&workers[i].tally.duplication);
+            overrepresented_free(&workers[i].tally.overrepresented);
+        }
+        overrepresented_merge(&tally->overrepresented, &ordered.summary);
+
+        for (i = 0; i < number_of_batches; i++)
+            free(batches[i].data);
+        free(batches);
+        free(workers);
+        free(ids);
+        batch_queue_destroy(&filled);
+        batch_queue_destroy(&empty);
+        pthread_mutex_destroy(&snapshot.lock);
+        pthread_cond_destroy(&snapshot.taken);
+        pthread_cond_destroy(&snapshot.resume);
+        ordered_summary_destroy(&ordered);
     }
+
+    if (profile_enabled) profile_stop(PROFILE_PARSE, &timer);
     kseq_destroy(seq);
-    gzclose(fp);
-    to_return->bases = bases;
-    to_return->max_length = max_length;
-    to_return->number_of_sequences = number_of_sequences;
-    return to_return;
+    input_close(fp);
+    if (checkpoints)
+        free(position);
+}
+
+/* Count the reads of `fastq_file`. `live` is NULL unless the file may still
+   be growing or snapshots were asked for; `section` says which file of the
+   report it is */
+sequence_data* read_fastq(char *fastq_file, kmer_index *kmers, int threads,
+                          const read_sampling *sampling, live_mode *live, int section) {
+    mapped_file *mapped = NULL;
+    read_tally tally;
+    sequence_data *data;
+
+    /* Uncompressed files are tallied in place, others go through kseq, as
+       do mapped files that are not four line FASTQ. A mapping can't follow
+       a growing file, take snapshots or keep checkpoints */
+    tally_init(&tally);
+    if (live == NULL)
+        mapped = mapped_open(fastq_file);
+    if (mapped == NULL || tally_mapped(mapped, kmers, threads, sampling, &tally) < 0) {
+        tally_stream(fastq_file, kmers, threads, sampling, live, section, &tally);
+    } else if (profile_enabled) {
+        profile_count(PROFILE_BYTES_COMPRESSED, mapped->length);
+        profile_count(PROFILE_BYTES_UNCOMPRESSED, mapped->length);
+    }
+    if (mapped != NULL)
+        mapped_close(mapped);
+    if (profile_enabled) {
+        profile_count(PROFILE_READS, tally.number_of_sequences);
+        profile_count(PROFILE_BASES, tally.total_bases);
+        profile_count(PROFILE_ADAPTER_PROBES, tally.adapter_probes);
+        profile_count(PROFILE_ADAPTER_HITS, tally.adapter_reads);
+    }
+
+    data = tally_data(&tally, kmers);
+    if (live != NULL && live->checkpoint != NULL) {
+        live_resumed(live, section, data);
+        live_checkpoint(live, section, sequence_data_copy(data), NULL);
+    }
+    return data;
+}
+
+/* Arguments and result of a read_fastq call run on its own thread */
+typedef struct {
+    char *fastq_file;
+    kmer_index *kmers;
+    int threads;
+    const read_sampling *sampling;
+    live_mode *live;
+    int section;
+    sequence_data *data;
+} ingest_job;
+
+void* ingest_run(void *arg) {
+    ingest_job *job = arg;
+    job->data = read_fastq(job->fastq_file, job->kmers, job->threads, job->sampling,
+                           job->live, job->section);
+    profile_flush();
+    return NULL;
 }
 
 sequence_data* transform(sequence_data* data) {
     int i, j;
+    int bin_size = 1;
     data->original_max_length = data->max_length;
     // binning
     if (data->max_length > 3000) {
         fprintf(stderr, "Binning...\n");
-        int bin_size = 100;
+        bin_size = 100;
         int unbinned;
         int binned = 0;
 
@@ -255,17 +1096,33 @@ sequence_data* transform(sequence_data* data) {
             // fprintf(stderr, "%d\n", data->bases[binned].length_count);
             data->bases[binned].length_count = data->bases[binned].length_count + data->bases[unbinned].length_count;
             data->bases[binned].kmer_count = data->bases[binned].kmer_count + data->bases[unbinned].kmer_count;
+            for (j = 0; j < data->adapters; j++) {
+                if (unbinned%bin_size == 0)
+                    data->adapter_hits[binned*data->adapters + j] = 0;
+                data->adapter_hits[binned*data->adapters + j] += data->adapter_hits[unbinned*data->adapters + j];
+            }
         }
         data->max_length = binned;
     }
 
+    /* Columns cover more than one position once binned, here or while
+       tallying; scale content back to one position so it fits the panel */
+    for (i = 0; i < data->max_length; i++) {
+        uint64_t last = (uint64_t)(i + 1)*bin_size;
+        uint64_t width = tally_bin_start((last < data->original_max_length)?last:data->original_max_length)
+            - tally_bin_start((uint64_t)i*bin_size);
+        for (j = 0; j < 4; j++)
+            data->bases[i].content[j] /= width;
+    }
+
     for (i = 1; i < data->max_length; i++) {
         data->bases[i].kmer_count = data->bases[i-1].kmer_count + data->bases[i].kmer_count;
+        for (j = 0; j < data->adapters; j++)
+            data->adapter_hits[i*data->adapters + j] += data->adapter_hits[(i-1)*data->adapters + j];
     }
 
     // transforming data for drawing (percentages rather than counts)
     for (i = 0; i < data->max_length; i++) {
-        int content_sum = 0;
         int score_sum = 0;
         /* for (j = 0; j < 4; j++) { */
         /*     content_sum = content_sum + data->bases[i].content[j]; */
@@ -290,33 +1147,80 @@ sequence_data* transform(sequence_data* data) {
     return data;
 }
 
-void draw(sequence_data* data, int position, int adapters_used) {
+/* Quality characters are counted from '!'. Returns 0 for phred33 data, or 31
+   when nothing scores below '@' and the data is taken to be phred64 */
+int quality_offset(sequence_data *data) {
+    uint64_t i;
+    int j;
+
+    for (i = 0; i < data->max_length; i++)
+        for (j = 0; j < 31; j++)
+            if (data->bases[i].scores[j] != 0)
+                return 0;
+    return 31;
+}
+
+/* Bars of `counts[0..n)` across a panel of `width` by 100 at (`x`, `y`),
+   the tallest reaching 90% of the way up, with `title` in the top left */
+static void draw_histogram(int x, int y, int width, const uint64_t *counts, int n, const char *title) {
+  uint64_t max = 0;
+  int i;
+
+  for (i = 0; i < n; i++)
+    if (counts[i] > max)
+      max = counts[i];
+  max += max/9 + 1;
+
+  svg_start_tag("svg", 6,
+                svg_attr("x",      "%d", x),
+                svg_attr("y",      "%d", y),
+                svg_attr("width",  "%d", width),
+                svg_attr("height", "%d", 100),
+                svg_attr("preserveAspectRatio", "%s", "none"),
+                svg_attr("viewBox", "0 0 %d %" PRIu64, n, max)
+                );
+  svg_simple_tag("rect", 3,
+                 svg_attr("width",  "%s", "100%"),
+                 svg_attr("height", "%s", "100%"),
+                 svg_attr("fill", "%s", "#EEE")
+                 );
+  for (i = 0; i < n; i++) {
+    if (counts[i] > 0)
+      svg_simple_tag("rect", 6,
+                     svg_attr("x",      "%d", i),
+                     svg_attr("y",      "%" PRIu64, max - counts[i]),
+                     svg_attr("width",  "%d", 1),
+                     svg_attr("height", "%" PRIu64, counts[i]),
+                     svg_attr("stroke", "%s", "none"),
+                     svg_attr("fill",   "%s", "steelblue")
+                     );
+  }
+  svg_end_tag("svg");
+
+  svg_start_tag("text", 5,
+                svg_attr("y",           "%d", y + 17),
+                svg_attr("fill",        "%s", "#888"),
+                svg_attr("x",           "%d", x + 5),
+                svg_attr("font-family", "%s", "sans-serif"),
+                svg_attr("font-size",   "%s", "15px")
+                );
+  svg_printf("%s\n", title);
+  svg_end_tag("text");
+}
+
+void draw(sequence_data* data, int position, int adapters_used, const char *note) {
   int i, j, x, y;
   int offset = 0;
   int sum = 0;
-  int counter = 0;
   char *encoding = "";
-  uint64_t min_score = UINT32_MAX;
   int max_score = 0;
   uint64_t number_of_bases = 0;
   uint64_t total_counts[91] = {0};
-  float averages[500];
+  double distinct;
+  float *averages = malloc(data->max_length*sizeof(float));
 
   // get encoding
-  i = 0;
-  while (i < data->max_length && strcmp(encoding, "") == 0) {
-    if (min_score < 31) {
-      encoding = "phred33";
-    }
-    for (j = 0; j < 91; j++) {
-      if (j < min_score) {
-        if (data->bases[i].scores[j] != 0) {
-          min_score = j;
-        }
-      }
-    }
-    i++;
-  }
+  offset = quality_offset(data);
 
   // get max score and score distribution and average scores at each position
   for (i = 0; i < data->max_length; i++) {
@@ -339,14 +1243,8 @@ void draw(sequence_data* data, int position, int adapters_used) {
     max_score++;
   }
 
-  if (min_score < 31) {
-    encoding = "phred33";
-  }
-  else {
-    encoding = "phred64";
-    offset = 31;
-    max_score = max_score - offset;
-  }
+  encoding = (offset == 0)?"phred33":"phred64";
+  max_score = max_score - offset;
 
 
   /********** File Stats ***************/
@@ -359,14 +1257,31 @@ void draw(sequence_data* data, int position, int adapters_used) {
                  svg_attr("fill", "%s", "#555")
                  );
    svg_start_tag("tspan", 0);
-   printf("%d", data->number_of_sequences);
+   svg_printf("%d", data->number_of_sequences);
    svg_end_tag("tspan");
    svg_start_tag("tspan", 1, svg_attr("fill", "%s", "#888"));
-   printf("&#160;reads with endcoding&#160;");
+   svg_printf("&#160;reads with endcoding&#160;");
    svg_end_tag("tspan");
    svg_start_tag("tspan", 0);
-   printf("%s", encoding);
+   svg_printf("%s", encoding);
    svg_end_tag("tspan");
+   if (data->number_of_sequences > 0) {
+     distinct = 100.0*duplication_distinct(&data->duplication)/data->number_of_sequences;
+     svg_start_tag("tspan", 1, svg_attr("fill", "%s", "#888"));
+     svg_printf(",&#160;");
+     svg_end_tag("tspan");
+     svg_start_tag("tspan", 0);
+     svg_printf("%.1f%%", (distinct < 100)?distinct:100);
+     svg_end_tag("tspan");
+     svg_start_tag("tspan", 1, svg_attr("fill", "%s", "#888"));
+     svg_printf("&#160;distinct");
+     svg_end_tag("tspan");
+   }
+   if (note[0] != '\0') {
+     svg_start_tag("tspan", 2, svg_attr("fill", "%s", "#888"), svg_attr("font-size", "%s", "11px"));
+     svg_printf("&#160;(%s)", note);
+     svg_end_tag("tspan");
+   }
    svg_end_tag("text");
   
   /* Group for rug plot */
@@ -434,21 +1349,7 @@ void draw(sequence_data* data, int position, int adapters_used) {
                  );
                  
   
-  /* Allocate 25 characters per base (A,C,T,G) per point. 
-     4 = max length is capped in kb range, will start compressing if larger
-     2 = '.5' added to point
-     1 = ','
-     15 = number of reads (10 quadrillion reads will break it)
-     1 = ' '
-     2 = padding for miscalculation
-     
-  */
-  size_t ratio_points_length = 25*data->max_length;
-  char * ratio_points[4];
-  char tmp[25];
-  for(i = 0; i < 4; i++){
-    ratio_points[i] = malloc(ratio_points_length);
-  }
+  svg_string ratio_points[4] = {{0}};
 
   /* Since coordinates for lines and rectangles don't work the same; set the
      first point of each line to start off graph. Then, add 0.5 to the x of each
@@ -456,7 +1357,7 @@ void draw(sequence_data* data, int position, int adapters_used) {
   y = 0;
   for(i = 0; i < 4; i++){
     y += data->bases[0].content[i];
-    snprintf(ratio_points[i], ratio_points_length, "0,%d ", y);
+    svg_string_printf(&ratio_points[i], "0,%d ", y);
   }
 
   /* Calculate cumlative sum for each x position and add it to point string */
@@ -464,9 +1365,7 @@ void draw(sequence_data* data, int position, int adapters_used) {
     y = 0;
     for(i = 0; i < 4; i++ ){
       y += data->bases[x].content[i];
-      
-      snprintf(tmp, 20, "%d.5,%d ", x, y);
-      strncat(ratio_points[i], tmp, ratio_points_length);
+      svg_string_printf(&ratio_points[i], "%d.5,%d ", x, y);
     }
   }
 
@@ -475,9 +1374,7 @@ void draw(sequence_data* data, int position, int adapters_used) {
   y = 0;
   for(i = 0; i < 4; i++){
     y += data->bases[data->max_length-1].content[i];
-
-    snprintf(tmp, 20, "%d,%d ", data->max_length, y);
-    strncat(ratio_points[i], tmp, ratio_points_length);
+    svg_string_printf(&ratio_points[i], "%d,%d ", data->max_length, y);
   }
 
   
@@ -486,14 +1383,14 @@ void draw(sequence_data* data, int position, int adapters_used) {
   char *ratio_colors[4] = {"#648964", "#89bc89", "#84accf", "#5d7992"};
   for(i = 3; i >= 0; i--){
     svg_simple_tag("polyline", 3,
-                   svg_attr("points",      "0,0 %s %d,0", ratio_points[i], data->max_length),
+                   svg_attr("points",      "0,0 %s %d,0", ratio_points[i].s, data->max_length),
                    svg_attr("fill", "%s", ratio_colors[i]),
                    svg_attr("stroke", "%s", "none")
                    );
   }
 
   for(i = 0; i < 4; i++)
-    free(ratio_points[i]);
+    svg_string_free(&ratio_points[i]);
 
   svg_end_tag("svg"); // Base Ratio
   svg_end_tag("g"); // Base Ratio
@@ -507,7 +1404,7 @@ void draw(sequence_data* data, int position, int adapters_used) {
                 svg_attr("font-family", "%s", "sans-serif"),
                 svg_attr("font-size",   "%s", "15px")
                 );
-  printf("%s\n", "Base Content Percentage");
+  svg_printf("%s\n", "Base Content Percentage");
   svg_end_tag("text");
 
 
@@ -558,47 +1455,50 @@ void draw(sequence_data* data, int position, int adapters_used) {
   score_back(28,        "#ffffcc"); // yellow
   score_back(20,        "#fbb4ae"); // red
 
-  /* Allocate 15 characters per point. 
-     4 = max length is capped in kb range, will start compressing if larger
-     2 = '.5' added to point
-     1 = ','
-     5 = '##.##' for float average
-     1 = ' '
-     2 = padding for miscalculation
-   */
-  size_t mean_line_points_length = 15*data->max_length;
-  char * mean_line_points = malloc(mean_line_points_length);
+  svg_string mean_line_points = {0};
 
   /* Make line start off graph */
-  snprintf(mean_line_points, mean_line_points_length, "0,%0.2f ", averages[0]);
+  svg_string_printf(&mean_line_points, "0,%0.2f ", averages[0]);
+
+  /* Cells are drawn as one path per opacity level rather than one rect each.
+     Scores are whole percentages, so there are at most 100 levels, and a run
+     of equal cells up a column becomes a single rectangle */
+  svg_string cells[101] = {{0}};
+  int run, level;
 
   for (x = 0; x < data->max_length; x++) {
-    for (y = offset; y < max_score+offset; y++) {
-      if(data->bases[x].scores[y] > 0)
-        svg_simple_tag("rect", 8,
-                       svg_attr("x",      "%d", x),
-                       svg_attr("y",      "%d", y),
-                       svg_attr("fill-opacity", "%f", (float)(data->bases[x].scores[y])/100.0),
-                       svg_attr("width",  "%d", 1),
-                       svg_attr("height", "%d", 1),
-                       svg_attr("stroke", "%s", "none"),
-                       svg_attr("stroke-width", "%d", 0),
-                       svg_attr("fill",   "%s", "black")
-                       );
+    for (y = offset; y < max_score+offset; y = run) {
+      level = (data->bases[x].scores[y] > 100)?100:data->bases[x].scores[y];
+      for (run = y+1; run < max_score+offset && data->bases[x].scores[run] == level; run++)
+        ;
+      if (level > 0)
+        svg_string_printf(&cells[level], "M%d %dh1v%dh-1z", x, y, run-y);
     }
 
-    snprintf(tmp, 20, "%d.5,%0.2f ", x, averages[x]);
-    strncat(mean_line_points, tmp, mean_line_points_length);
+    svg_string_printf(&mean_line_points, "%d.5,%0.2f ", x, averages[x]);
+  }
+
+  svg_start_tag("g", 2,
+                svg_attr("fill",   "%s", "black"),
+                svg_attr("stroke", "%s", "none")
+                );
+  for (level = 1; level <= 100; level++) {
+    if (cells[level].length > 0)
+      svg_simple_tag("path", 2,
+                     svg_attr("fill-opacity", "%g", level/100.0),
+                     svg_attr("d", "%s", cells[level].s)
+                     );
+    svg_string_free(&cells[level]);
   }
+  svg_end_tag("g");
 
   /* Make line end off graph */
-  snprintf(tmp, 20, "%d,%0.2f", data->max_length, averages[data->max_length-1]);
-  strncat(mean_line_points, tmp, mean_line_points_length);
+  svg_string_printf(&mean_line_points, "%d,%0.2f", data->max_length, averages[data->max_length-1]);
 
   
   /* Print mean line */
   svg_simple_tag("polyline", 6,
-                 svg_attr("points",      "%s", mean_line_points),
+                 svg_attr("points",      "%s", mean_line_points.s),
                  svg_attr("stroke", "%s", "black"),
                  svg_attr("stroke-width", "%f", 0.5),
                  svg_attr("stroke-opacity", "%f", 0.5),
@@ -606,7 +1506,8 @@ void draw(sequence_data* data, int position, int adapters_used) {
                  svg_attr("stroke-linejoin", "%s", "round")
                  );
    
-  free(mean_line_points);
+  svg_string_free(&mean_line_points);
+  free(averages);
     
   svg_end_tag("svg"); // Heatmap
   svg_end_tag("g"); // Heatmap
@@ -621,7 +1522,7 @@ void draw(sequence_data* data, int position, int adapters_used) {
                 svg_attr("font-family", "%s", "sans-serif"),
                 svg_attr("font-size",   "%s", "15px")
                 );
-  printf("%s\n", "Per Base Sequence Quality");
+  svg_printf("%s\n", "Per Base Sequence Quality");
   svg_end_tag("text");
 
 
@@ -682,7 +1583,7 @@ void draw(sequence_data* data, int position, int adapters_used) {
                 svg_attr("font-family", "%s", "sans-serif"),
                 svg_attr("font-size",   "%s", "15px")
                 );
-  printf("%s\n", "Length Distribution");
+  svg_printf("%s\n", "Length Distribution");
   svg_end_tag("text");
 
   if(position == 0){
@@ -699,6 +1600,25 @@ void draw(sequence_data* data, int position, int adapters_used) {
   /*************** Adapter Distro ***************/
 
   if(adapters_used==1){
+    /* Pick the adapters found in the most reads, by their cumulative count at
+       the last position */
+    char *adapter_colors[ADAPTER_LINES] = {"#d95f02", "#7570b3", "#e7298a", "#66a61e"};
+    int top[ADAPTER_LINES];
+    int top_adapters = 0;
+    uint64_t *last = (data->adapter_hits == NULL)?NULL:
+      data->adapter_hits + (data->max_length-1)*data->adapters;
+
+    for (j = 0; last != NULL && j < data->adapters; j++) {
+      if (last[j] == 0)
+        continue;
+      for (i = top_adapters; i > 0 && last[top[i-1]] < last[j]; i--)
+        if (i < ADAPTER_LINES) top[i] = top[i-1];
+      if (i < ADAPTER_LINES) {
+        top[i] = j;
+        if (top_adapters < ADAPTER_LINES) top_adapters++;
+      }
+    }
+
     /* Adapter Distro graph grows away from heatmap. No need to flip or have
        negative y*/
     svg_start_tag("svg", 6,
@@ -729,8 +1649,44 @@ void draw(sequence_data* data, int position, int adapters_used) {
                        );
     }
 
+    /* One line for each of the most common adapters */
+    for (i = 0; i < top_adapters; i++) {
+      uint64_t *hits = data->adapter_hits + top[i];
+      float total = data->number_of_sequences;
+      svg_string adapter_points = {0};
+
+      svg_string_printf(&adapter_points, "0,%0.2f ", 100*hits[0]/total);
+      for (x = 0; x < data->max_length; x++)
+        svg_string_printf(&adapter_points, "%d.5,%0.2f ", x, 100*hits[x*data->adapters]/total);
+      svg_string_printf(&adapter_points, "%d,%0.2f", data->max_length,
+                        100*hits[(data->max_length-1)*data->adapters]/total);
+
+      svg_simple_tag("polyline", 5,
+                     svg_attr("points",        "%s", adapter_points.s),
+                     svg_attr("stroke",        "%s", adapter_colors[i]),
+                     svg_attr("stroke-width",  "%f", 1.5),
+                     svg_attr("fill",          "%s", "none"),
+                     svg_attr("vector-effect", "%s", "non-scaling-stroke")
+                     );
+      svg_string_free(&adapter_points);
+    }
+
     svg_end_tag("svg"); // Adapter Distro
 
+    /* Legend in the top left, where the cumulative bars are shortest */
+    for (i = 0; i < top_adapters; i++) {
+      svg_start_tag("text", 5,
+                    svg_attr("x",           "%d", 5),
+                    svg_attr("y",           "%d", 477 + 12*i),
+                    svg_attr("fill",        "%s", adapter_colors[i]),
+                    svg_attr("font-family", "%s", "sans-serif"),
+                    svg_attr("font-size",   "%s", "10px")
+                    );
+      svg_printf("%s %0.1f%%\n", data->adapter_names[top[i]],
+                 100*(float)data->adapter_hits[(data->max_length-1)*data->adapters + top[i]]/data->number_of_sequences);
+      svg_end_tag("text");
+    }
+
     /* Lables */
 
     svg_start_tag("text", 5,
@@ -740,7 +1696,7 @@ void draw(sequence_data* data, int position, int adapters_used) {
                   svg_attr("font-family", "%s", "sans-serif"),
                   svg_attr("font-size",   "%s", "15px")
                   );
-    printf("%s\n", "Adapter Distribution");
+    svg_printf("%s\n", "Adapter Distribution");
     svg_end_tag("text");
 
     if(position == 0){
@@ -758,9 +1714,40 @@ void draw(sequence_data* data, int position, int adapters_used) {
   y = 470;
   if(adapters_used==1) y+=105;
   
-  svg_axis_label(225,  y+5, 0, "Base Pairs");
+  /* Positions past TALLY_EXACT were counted in log scaled bins; a dashed
+     line marks where they start */
+  if(data->original_max_length > TALLY_EXACT){
+    x = 450.0*TALLY_EXACT/data->original_max_length;
+    svg_simple_tag("line", 6,
+                   svg_attr("x1", "%d", x),
+                   svg_attr("y1", "%d", 0),
+                   svg_attr("x2", "%d", x),
+                   svg_attr("y2", "%d", y-10),
+                   svg_attr("stroke", "%s", "#AAA"),
+                   svg_attr("stroke-dasharray", "%s", "4,4"));
+    char label[64];
+    snprintf(label, sizeof(label), "Base Pairs, log scale past %d", TALLY_EXACT);
+    svg_axis_label(225,  y+5, 0, label);
+  }else{
+    svg_axis_label(225,  y+5, 0, "Base Pairs");
+  }
   svg_axis_number(0,   y, "middle", 0);
-  svg_axis_number(450, y, "middle", 100);
+  svg_axis_number(450, y, "middle", (int)tally_bin_start(data->original_max_length));
+
+  /*************** Per Read Histograms ***************/
+
+  /* Reads by their share of G and C bases, and by their mean quality, on
+     the scale of the heatmap */
+  y += 20;
+  draw_histogram(0, y, 215, data->gc, TALLY_GC_BINS, "Per Read GC Content");
+  svg_axis_number(0,   y+112, "middle", 0);
+  svg_axis_number(215, y+112, "middle", 100);
+  svg_axis_label(107,  y+117, 0, "Percent");
+
+  draw_histogram(235, y, 215, data->mean_quality + offset, max_score, "Per Read Mean Quality");
+  svg_axis_number(235, y+112, "middle", 0);
+  svg_axis_number(450, y+112, "middle", max_score);
+  svg_axis_label(342,  y+117, 0, "Score");
 
   
   svg_end_tag("g"); // rug plot vertical section
@@ -815,11 +1802,11 @@ void draw(sequence_data* data, int position, int adapters_used) {
                     svg_attr("font-size",   "%s", "15px")
                     );
       svg_start_tag("tspan", 0);
-      printf("%s\n", "Score");
+      svg_printf("%s\n", "Score");
       svg_end_tag("tspan");
     
       svg_start_tag("tspan", 2, svg_attr("dy", "%d", 15), svg_attr("x", "%d", 30));
-      printf("%s\n", "Distribution");
+      svg_printf("%s\n", "Distribution");
       svg_end_tag("tspan");
 
       svg_end_tag("text");
@@ -841,11 +1828,11 @@ void draw(sequence_data* data, int position, int adapters_used) {
                     svg_attr("font-size",   "%s", "15px")
                     );
       svg_start_tag("tspan", 0);
-      printf("%s\n", "Score");
+      svg_printf("%s\n", "Score");
       svg_end_tag("tspan");
     
       svg_start_tag("tspan", 2, svg_attr("dy", "%d", 15), svg_attr("x", "%d", 1070));
-      printf("%s\n", "Distribution");
+      svg_printf("%s\n", "Distribution");
       svg_end_tag("tspan");
 
       svg_end_tag("text");
@@ -863,31 +1850,266 @@ void draw(sequence_data* data, int position, int adapters_used) {
 
 }
 
-int main (int argc, char **argv)
-{
-    struct arguments arguments;
-    arguments = parse_options(argc, argv);
+/*************** Statistics output ***************/
+
+/* Print `s` as a JSON string */
+void print_json_string(FILE *out, const char *s) {
+    fputc('"', out);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            fprintf(out, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            fprintf(out, "\\u%04x", *s);
+        else
+            fputc(*s, out);
+    }
+    fputc('"', out);
+}
 
-    int paired, unpaired, adapters;
-    int width, height;
-    int *kmers = NULL;
+/* Lowest and highest quality columns with any bases in them */
+void quality_range(sequence_data *data, int *low, int *high) {
+    uint64_t i;
+    int j;
 
-    paired = (arguments.forward != NULL && arguments.reverse != NULL);
-    unpaired = (arguments.unpaired != NULL);
-    adapters = (arguments.adapters != NULL);
-    
-    /* If paired and unparied data are both set or unset, then throw error */
-    if(paired == unpaired){
-      printf("%s\n", "Usage: quack [OPTION...]\nTry `quack --help' or `quack --usage' for more information.");
-      exit(1);
+    *low = 91;
+    *high = -1;
+    for (i = 0; i < data->max_length; i++) {
+        for (j = 0; j < 91; j++) {
+            if (data->bases[i].scores[j] != 0) {
+                if (j < *low) *low = j;
+                if (j > *high) *high = j;
+            }
+        }
     }
+    if (*high < 0)
+        *low = *high = 0;
+}
+
+/* Print a JSON array of `count` counters, `stride` apart */
+void print_json_counts(FILE *out, const uint64_t *counts, uint64_t count, uint64_t stride) {
+    uint64_t i;
+
+    fputc('[', out);
+    for (i = 0; i < count; i++)
+        fprintf(out, (i == 0)?"%" PRIu64:",%" PRIu64, counts[i*stride]);
+    fputc(']', out);
+}
 
-    if(adapters) kmers = read_adapters(arguments.adapters);
+/* Print the raw counts of each file as JSON. Positions are 1 based, so the
+   first entry of every per-position array is position 1. Past TALLY_EXACT an
+   entry covers a bin of positions, listed in `bin_start`. `note` says how the
+   reads were sampled, empty if they all were. */
+void write_json(FILE *out, sequence_data **data, char **files, int count, int adapters_used,
+                const char *note) {
+    static const char bases[4] = {'A', 'T', 'C', 'G'};
+    uint64_t i, *column = NULL, sequences[DUPLICATION_LEVELS], reads[DUPLICATION_LEVELS];
+    const overrepresented_entry *top[OVERREPRESENTED_REPORT_MAX];
+    int f, j, a, offset, low, high, n;
+
+    fprintf(out, "{\n  \"version\": ");
+    print_json_string(out, program_version);
+    fprintf(out, ",\n  \"files\": [");
+
+    for (f = 0; f < count; f++) {
+        sequence_data *d = data[f];
+
+        column = realloc(column, (d->max_length + 1)*sizeof(uint64_t));
+        offset = quality_offset(d);
+        quality_range(d, &low, &high);
+
+        fprintf(out, (f == 0)?"\n    {\n":",\n    {\n");
+        fprintf(out, "      \"file\": ");
+        print_json_string(out, files[f]);
+        fprintf(out, ",\n      \"reads\": %" PRIu64 ",\n", d->number_of_sequences);
+        fprintf(out, "      \"encoding\": \"%s\",\n", (offset == 0)?"phred33":"phred64");
+        fprintf(out, "      \"sampling\": ");
+        print_json_string(out, note);
+        fprintf(out, ",\n");
+        fprintf(out, "      \"max_length\": %" PRIu64 ",\n", tally_bin_start(d->max_length));
+        if (d->max_length > TALLY_EXACT) {
+            for (i = 0; i < d->max_length; i++)
+                column[i] = tally_bin_start(i) + 1;
+            fprintf(out, "      \"bin_start\": ");
+            print_json_counts(out, column, d->max_length, 1);
+            fprintf(out, ",\n");
+        }
 
-    width  = (paired)?1195:615;
-    height = (adapters)?610:510;
+        fprintf(out, "      \"content\": {");
+        for (j = 0; j < 4; j++) {
+            for (i = 0; i < d->max_length; i++)
+                column[i] = d->bases[i].content[j];
+            fprintf(out, (j == 0)?"\"%c\": ":", \"%c\": ", bases[j]);
+            print_json_counts(out, column, d->max_length, 1);
+        }
+        fprintf(out, "},\n");
+
+        /* One row per position, from Phred `quality_min` up */
+        fprintf(out, "      \"quality_min\": %d,\n", low - offset);
+        fprintf(out, "      \"quality\": [");
+        for (i = 0; i < d->max_length; i++) {
+            fprintf(out, (i == 0)?"\n        ":",\n        ");
+            print_json_counts(out, d->bases[i].scores + low, high - low + 1, 1);
+        }
+        fprintf(out, "\n      ],\n");
+
+        /* Reads of each length, from 1 */
+        for (i = 0; i < d->max_length; i++)
+            column[i] = d->bases[i].length_count;
+        fprintf(out, "      \"length\": ");
+        print_json_counts(out, column, d->max_length, 1);
+
+        /* Reads by percentage of G and C bases, from 0, and by mean
+           quality, from `quality_min` */
+        fprintf(out, ",\n      \"gc\": ");
+        print_json_counts(out, d->gc, TALLY_GC_BINS, 1);
+        fprintf(out, ",\n      \"mean_quality\": ");
+        print_json_counts(out, d->mean_quality + low, high - low + 1, 1);
+
+        /* Sampled sequences and their reads at each duplication level, from
+           a 1 in `sampled_one_in` sample of the distinct sequences */
+        duplication_levels(&d->duplication, sequences, reads);
+        fprintf(out, ",\n      \"duplication\": {\"distinct\": %" PRIu64 ", \"sampled_one_in\": %" PRIu64 ",\n",
+                duplication_distinct(&d->duplication), (uint64_t)1 << d->duplication.level);
+        fprintf(out, "        \"levels\": ");
+        print_json_counts(out, duplication_level_start, DUPLICATION_LEVELS, 1);
+        fprintf(out, ",\n        \"sequences\": ");
+        print_json_counts(out, sequences, DUPLICATION_LEVELS, 1);
+        fprintf(out, ",\n        \"reads\": ");
+        print_json_counts(out, reads, DUPLICATION_LEVELS, 1);
+        fprintf(out, "}");
+
+        /* Sequences of at least 0.1% of reads, which had between
+           `reads - error` and `reads`, that is a `fraction` of all reads at
+           most `error_fraction` too high */
+        n = overrepresented_top(&d->overrepresented, d->number_of_sequences, top);
+        fprintf(out, ",\n      \"overrepresented\": [");
+        for (j = 0; j < n; j++) {
+            fprintf(out, (j == 0)?"\n        {\"sequence\": ":",\n        {\"sequence\": ");
+            print_json_string(out, top[j]->seq);
+            fprintf(out, ", \"reads\": %" PRIu64 ", \"error\": %" PRIu64 ", \"fraction\": %.6f, \"error_fraction\": %.6f}",
+                    top[j]->count, top[j]->error, (double)top[j]->count/d->number_of_sequences,
+                    (double)top[j]->error/d->number_of_sequences);
+        }
+        fprintf(out, (n > 0)?"\n      ]":"]");
+
+        /* Reads whose first adapter k-mer ends at each position */
+        if (adapters_used) {
+            for (i = 0; i < d->max_length; i++)
+                column[i] = d->bases[i].kmer_count;
+            fprintf(out, ",\n      \"adapter\": ");
+            print_json_counts(out, column, d->max_length, 1);
+
+            fprintf(out, ",\n      \"adapters\": [");
+            for (a = 0; a < d->adapters; a++) {
+                uint64_t total = 0;
+                for (i = 0; d->adapter_hits != NULL && i < d->max_length; i++)
+                    total += d->adapter_hits[i*d->adapters + a];
+                fprintf(out, (a == 0)?"\n        {\"name\": ":",\n        {\"name\": ");
+                print_json_string(out, d->adapter_names[a]);
+                fprintf(out, ", \"reads\": %" PRIu64, total);
+                if (total > 0) {
+                    fprintf(out, ", \"positions\": ");
+                    print_json_counts(out, d->adapter_hits + a, d->max_length, d->adapters);
+                }
+                fprintf(out, "}");
+            }
+            fprintf(out, "\n      ]");
+        }
+        fprintf(out, "\n    }");
+    }
+    fprintf(out, "\n  ]\n}\n");
+    free(column);
+}
+
+/* Print the raw counts of each file as one long table: file, section,
+   position, key, value. Only non-zero counts are listed past the summary.
+   Past TALLY_EXACT the position is the first of its bin. */
+void write_tsv(FILE *out, sequence_data **data, char **files, int count, int adapters_used,
+               const char *note) {
+    static const char bases[4] = {'A', 'T', 'C', 'G'};
+    uint64_t i, sequences[DUPLICATION_LEVELS], reads[DUPLICATION_LEVELS];
+    const overrepresented_entry *top[OVERREPRESENTED_REPORT_MAX];
+    int f, j, a, offset, n;
+
+    fprintf(out, "file\tsection\tposition\tkey\tvalue\n");
+    for (f = 0; f < count; f++) {
+        sequence_data *d = data[f];
+        offset = quality_offset(d);
+
+        fprintf(out, "%s\tsummary\t\treads\t%" PRIu64 "\n", files[f], d->number_of_sequences);
+        fprintf(out, "%s\tsummary\t\tencoding\t%s\n", files[f], (offset == 0)?"phred33":"phred64");
+        fprintf(out, "%s\tsummary\t\tsampling\t%s\n", files[f], note);
+        fprintf(out, "%s\tsummary\t\tmax_length\t%" PRIu64 "\n", files[f], tally_bin_start(d->max_length));
+        fprintf(out, "%s\tsummary\t\tdistinct\t%" PRIu64 "\n", files[f], duplication_distinct(&d->duplication));
+        fprintf(out, "%s\tsummary\t\tduplication_sampled_one_in\t%" PRIu64 "\n", files[f],
+                (uint64_t)1 << d->duplication.level);
+
+        /* The position of a duplication level is the fewest copies in it */
+        duplication_levels(&d->duplication, sequences, reads);
+        for (j = 0; j < DUPLICATION_LEVELS; j++) {
+            if (sequences[j] == 0)
+                continue;
+            fprintf(out, "%s\tduplication\t%" PRIu64 "\tsequences\t%" PRIu64 "\n", files[f],
+                    duplication_level_start[j], sequences[j]);
+            fprintf(out, "%s\tduplication\t%" PRIu64 "\treads\t%" PRIu64 "\n", files[f],
+                    duplication_level_start[j], reads[j]);
+        }
+
+        /* The position of a per read GC row is the percentage, and of a mean
+           quality row the score */
+        for (j = 0; j < TALLY_GC_BINS; j++)
+            if (d->gc[j] != 0)
+                fprintf(out, "%s\tgc\t%d\treads\t%" PRIu64 "\n", files[f], j, d->gc[j]);
+        for (j = 0; j < 91; j++)
+            if (d->mean_quality[j] != 0)
+                fprintf(out, "%s\tmean_quality\t%d\treads\t%" PRIu64 "\n", files[f], j - offset,
+                        d->mean_quality[j]);
+
+        /* The position of an overrepresented sequence is its rank */
+        n = overrepresented_top(&d->overrepresented, d->number_of_sequences, top);
+        for (j = 0; j < n; j++) {
+            fprintf(out, "%s\toverrepresented\t%d\tsequence\t%s\n", files[f], j + 1, top[j]->seq);
+            fprintf(out, "%s\toverrepresented\t%d\treads\t%" PRIu64 "\n", files[f], j + 1, top[j]->count);
+            fprintf(out, "%s\toverrepresented\t%d\terror\t%" PRIu64 "\n", files[f], j + 1, top[j]->error);
+            fprintf(out, "%s\toverrepresented\t%d\tfraction\t%.6f\n", files[f], j + 1,
+                    (double)top[j]->count/d->number_of_sequences);
+        }
+
+        for (i = 0; i < d->max_length; i++) {
+            base_information *base = &d->bases[i];
+            uint64_t position = tally_bin_start(i) + 1;
+            for (j = 0; j < 4; j++)
+                if (base->content[j] != 0)
+                    fprintf(out, "%s\tcontent\t%" PRIu64 "\t%c\t%" PRIu64 "\n",
+                            files[f], position, bases[j], base->content[j]);
+            for (j = 0; j < 91; j++)
+                if (base->scores[j] != 0)
+                    fprintf(out, "%s\tquality\t%" PRIu64 "\t%d\t%" PRIu64 "\n",
+                            files[f], position, j - offset, base->scores[j]);
+            if (base->length_count != 0)
+                fprintf(out, "%s\tlength\t%" PRIu64 "\treads\t%" PRIu64 "\n", files[f], position, base->length_count);
+            if (adapters_used && base->kmer_count != 0)
+                fprintf(out, "%s\tadapter\t%" PRIu64 "\tany\t%" PRIu64 "\n", files[f], position, base->kmer_count);
+            for (a = 0; d->adapter_hits != NULL && a < d->adapters; a++)
+                if (d->adapter_hits[i*d->adapters + a] != 0)
+                    fprintf(out, "%s\tadapter\t%" PRIu64 "\t%s\t%" PRIu64 "\n", files[f], position,
+                            d->adapter_names[a], d->adapter_hits[i*d->adapters + a]);
+        }
+    }
+}
 
-    if(arguments.name != NULL)
+/*************** Reports ***************/
+
+/* Draw the SVG report of one run, forward then reverse when paired */
+void write_svg(sequence_data *data, sequence_data *reverse_data, int adapters_used, char *name,
+               const char *note) {
+    int width, height;
+    profile_timer timer;
+
+    width  = (reverse_data != NULL)?1195:615;
+    height = (adapters_used)?750:650;
+
+    if(name != NULL)
       height += 30;
     
     svg_start_tag("svg", 5,
@@ -899,7 +2121,7 @@ int main (int argc, char **argv)
                   );
 
     // If name is given, add to middle of viewBox (half of width + min-x of viewbox)
-    if(arguments.name != NULL){
+    if(name != NULL){
       svg_start_tag("text", 6,
                     svg_attr("x", "%d", (width/2)),
                     svg_attr("y", "%d", 30),
@@ -907,7 +2129,7 @@ int main (int argc, char **argv)
                     svg_attr("text-anchor", "%s", "middle"),
                     svg_attr("font-size",   "%s", "30px"),
                     svg_attr("fill",        "%s", "black"));
-      printf("%s", arguments.name);
+      svg_printf("%s", name);
       svg_end_tag("text");
 
       svg_start_tag("g", 1, 
@@ -916,21 +2138,457 @@ int main (int argc, char **argv)
 
     }
   
-    sequence_data *data = read_fastq(((paired)?arguments.forward:arguments.unpaired), kmers);
-    sequence_data *transformed_data = transform(data);
-    draw(transformed_data, 0, adapters);
-    free(data);
-    
-    if(paired){
-      data = read_fastq(arguments.reverse, kmers);
-      transformed_data = transform(data);
-      draw(transformed_data, 1, adapters);
-      free(data);
-    }
+    if(profile_enabled) profile_start(&timer);
+    transform(data);
+    if(reverse_data != NULL)
+      transform(reverse_data);
+    if(profile_enabled) profile_stop(PROFILE_TRANSFORM, &timer);
 
-    if(arguments.name != NULL) svg_end_tag("g");
+    draw(data, 0, adapters_used, note);
+    if(reverse_data != NULL)
+      draw(reverse_data, 1, adapters_used, note);
+
+    if(name != NULL) svg_end_tag("g");
 
     svg_end_tag("svg");
-    
+}
+
+/* Write the report of one run to `out` and free its counts.
+     - `data`  = `info->sections` sets of counts, forward first when paired
+     - `files` = what each set is called in JSON and TSV output
+     - `note`  = how the reads were sampled, empty if they all were
+ */
+void write_report(FILE *out, enum output_format format, sequence_data **data, char **files,
+                  const stats_info *info, char *name, const char *note) {
+    profile_timer timer;
+    int i;
+
+    if(profile_enabled) profile_start(&timer);
+    /* Statistics skip binning and drawing, and are written as raw counts */
+    if(format == OUTPUT_SVG){
+      svg_set_output(out);
+      write_svg(data[0], (info->sections == 2)?data[1]:NULL, info->adapters_used, name, note);
+      svg_flush();
+    }else if(format == OUTPUT_JSON){
+      write_json(out, data, files, info->sections, info->adapters_used, note);
+    }else if(format == OUTPUT_TSV){
+      write_tsv(out, data, files, info->sections, info->adapters_used, note);
+    }else{
+      stats_write(out, data, info);
+    }
+
+    for(i = 0; i < info->sections; i++)
+      sequence_data_free(data[i]);
+    if(profile_enabled) profile_stop(PROFILE_RENDER, &timer);
+}
+
+/* Rewrite the snapshot file from the latest counts, once every file has
+   some. The report goes to a temporary file renamed over the old one, so the
+   snapshot is never seen half written. Call with `live->lock` held. */
+static void live_write(live_mode *live) {
+    char path[PATH_MAX];
+    sequence_data *copies[2];
+    FILE *out;
+    int i;
+
+    for(i = 0; i < live->info.sections; i++)
+      if(live->latest[i] == NULL || live->latest[i]->number_of_sequences == 0)
+        return;
+
+    snprintf(path, sizeof(path), "%s.tmp", live->snapshot);
+    out = fopen(path, "w");
+    if(out == NULL){
+      fprintf(stderr, "quack: cannot write %s\n", path);
+      exit(1);
+    }
+    /* write_report frees, and drawing changes, the counts it is given */
+    for(i = 0; i < live->info.sections; i++)
+      copies[i] = sequence_data_copy(live->latest[i]);
+    write_report(out, live->format, copies, live->files, &live->info, live->name, live->note);
+    fclose(out);
+    if(rename(path, live->snapshot) != 0){
+      fprintf(stderr, "quack: cannot write %s\n", live->snapshot);
+      exit(1);
+    }
+}
+
+/* Take `data` as the latest counts of file `section` and update the
+   snapshot */
+void live_update(live_mode *live, int section, sequence_data *data) {
+    pthread_mutex_lock(&live->lock);
+    if(live->latest[section] != NULL)
+      sequence_data_free(live->latest[section]);
+    live->latest[section] = data;
+    live_write(live);
+    pthread_mutex_unlock(&live->lock);
+}
+
+/* Add the counts the checkpoint had for file `section` to `data`, when
+   resuming */
+sequence_data* live_resumed(live_mode *live, int section, sequence_data *data) {
+    if(live->resumed[section] != NULL)
+      sequence_data_add(data, live->resumed[section]);
+    return data;
+}
+
+/* Take `data` as the counts of file `section` read up to `position`, NULL
+   once the whole file is read, and rewrite the checkpoint */
+void live_checkpoint(live_mode *live, int section, sequence_data *data,
+                     const checkpoint_position *position) {
+    pthread_mutex_lock(&live->lock);
+    sequence_data_free(live->saved[section]);
+    live->saved[section] = data;
+    if(position != NULL)
+      live->positions[section] = *position;
+    else
+      live->positions[section].done = 1;
+    checkpoint_write(live->checkpoint, live->saved, &live->info, live->files,
+                     live->positions, &live->settings);
+    pthread_mutex_unlock(&live->lock);
+}
+
+/*************** Batch mode ***************/
+
+/* One line of a batch manifest */
+typedef struct {
+    char *name, *output;
+    char *files[2];
+    sequence_data *data[2];
+    stats_info info;
+    /* Files still being read */
+    int remaining;
+} batch_sample;
+
+/* Samples shared by the batch workers. Each worker takes the next file,
+   paired files being separate jobs, and whoever reads the last file of a
+   sample writes its report. The `idle` threads, those not reading a file,
+   are shared out between the `files_left` files not yet started, so the
+   pool stays busy when there are fewer files than threads. */
+typedef struct {
+    batch_sample *samples;
+    int count;
+    int next_sample, next_file;
+    int idle, files_left;
+    kmer_index *kmers;
+    const read_sampling *sampling;
+    char note[128];
+    enum output_format format;
+    pthread_mutex_t lock;
+} batch_pool;
+
+/* Read a manifest of tab separated name, output and one or two FASTQ files.
+   Blank lines and lines starting with '#' are skipped. */
+batch_sample* read_manifest(char *path, int *count) {
+    FILE *fp = fopen(path, "r");
+    char *line = NULL, *field, *fields[5];
+    size_t capacity = 0;
+    int number, n, line_number = 0, allocated = 0;
+    batch_sample *samples = NULL;
+
+    if (fp == NULL) {
+        fprintf(stderr, "quack: cannot open %s\n", path);
+        exit(1);
+    }
+
+    *count = 0;
+    while (getline(&line, &capacity, fp) >= 0) {
+        line_number++;
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#')
+            continue;
+
+        for (n = 0, field = strtok(line, "\t"); field != NULL && n < 5; field = strtok(NULL, "\t"))
+            fields[n++] = field;
+        if (n < 3 || n > 4) {
+            fprintf(stderr, "quack: %s:%d: expected name, output and one or two FASTQ files\n",
+                    path, line_number);
+            exit(1);
+        }
+
+        if (*count == allocated) {
+            allocated = (allocated > 0)?2*allocated:64;
+            samples = realloc(samples, allocated*sizeof(batch_sample));
+        }
+        number = (*count)++;
+        memset(&samples[number], 0, sizeof(batch_sample));
+        samples[number].name = strdup(fields[0]);
+        samples[number].output = strdup(fields[1]);
+        samples[number].files[0] = strdup(fields[2]);
+        samples[number].files[1] = (n == 4)?strdup(fields[3]):NULL;
+        samples[number].remaining = n - 2;
+    }
+    free(line);
+    fclose(fp);
+    return samples;
+}
+
+void* batch_worker(void *arg) {
+    batch_pool *pool = arg;
+    batch_sample *sample;
+    sequence_data *data;
+    FILE *out;
+    int file, done, threads;
+
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        if (pool->next_sample == pool->count) {
+            pthread_mutex_unlock(&pool->lock);
+            svg_release();
+            profile_flush();
+            return NULL;
+        }
+        sample = &pool->samples[pool->next_sample];
+        file = pool->next_file++;
+        if (pool->next_file == sample->info.sections) {
+            pool->next_sample++;
+            pool->next_file = 0;
+        }
+        /* Workers finding nothing left exit, leaving their threads to the
+           files still being read */
+        threads = pool->idle/pool->files_left--;
+        if (threads < 1)
+            threads = 1;
+        pool->idle -= threads;
+        pthread_mutex_unlock(&pool->lock);
+
+        data = read_fastq(sample->files[file], pool->kmers, threads, pool->sampling, NULL, 0);
+
+        pthread_mutex_lock(&pool->lock);
+        sample->data[file] = data;
+        done = (--sample->remaining == 0);
+        pool->idle += threads;
+        pthread_mutex_unlock(&pool->lock);
+        if (!done)
+            continue;
+
+        out = fopen(sample->output, "w");
+        if (out == NULL) {
+            fprintf(stderr, "quack: cannot write %s\n", sample->output);
+            exit(1);
+        }
+        write_report(out, pool->format, sample->data, sample->files, &sample->info, sample->name,
+                     pool->note);
+        if (fclose(out) != 0) {
+            fprintf(stderr, "quack: cannot write %s\n", sample->output);
+            exit(1);
+        }
+    }
+}
+
+/* Run every sample in `manifest` on `threads` workers, sharing one adapter
+   index */
+void run_batch(char *manifest, kmer_index *kmers, int kmer_size, int threads,
+               const read_sampling *sampling, enum output_format format) {
+    batch_pool pool;
+    pthread_t *ids;
+    int i, workers;
+
+    memset(&pool, 0, sizeof(batch_pool));
+    pool.samples = read_manifest(manifest, &pool.count);
+    pool.kmers = kmers;
+    pool.sampling = sampling;
+    sampling_note(sampling, pool.note, sizeof(pool.note));
+    pool.format = format;
+    pthread_mutex_init(&pool.lock, NULL);
+    pool.idle = threads;
+    for (i = 0; i < pool.count; i++) {
+        pool.samples[i].info.sections = pool.samples[i].remaining;
+        pool.files_left += pool.samples[i].remaining;
+        pool.samples[i].info.adapters_used = (kmers != NULL);
+        pool.samples[i].info.kmer_size = (kmers != NULL)?kmer_size:0;
+    }
+
+    /* No more workers than files, the others' threads go to the files */
+    workers = (threads < pool.files_left)?threads:pool.files_left;
+    ids = malloc(workers*sizeof(pthread_t));
+    for (i = 0; i < workers; i++)
+        pthread_create(&ids[i], NULL, batch_worker, &pool);
+    for (i = 0; i < workers; i++)
+        pthread_join(ids[i], NULL);
+
+    for (i = 0; i < pool.count; i++) {
+        free(pool.samples[i].name);
+        free(pool.samples[i].output);
+        free(pool.samples[i].files[0]);
+        free(pool.samples[i].files[1]);
+    }
+    free(pool.samples);
+    free(ids);
+    pthread_mutex_destroy(&pool.lock);
+}
+
+/* Write the --profile report to `path`, or stderr for - */
+static void write_profile(const char *path) {
+    FILE *out = (strcmp(path, "-") == 0)?stderr:fopen(path, "w");
+
+    if (out == NULL) {
+        fprintf(stderr, "quack: cannot write %s\n", path);
+        exit(1);
+    }
+    profile_write(out, program_version);
+    if (out != stderr && fclose(out) != 0) {
+        fprintf(stderr, "quack: cannot write %s\n", path);
+        exit(1);
+    }
+}
+
+int main (int argc, char **argv)
+{
+    struct arguments arguments;
+    arguments = parse_options(argc, argv);
+
+    int paired, unpaired, adapters;
+    int i;
+    kmer_index *kmers = NULL;
+    sequence_data *data[2] = {NULL, NULL};
+    char *files[2] = {NULL, NULL};
+    char note[128] = "";
+    stats_info info;
+    live_mode live = {0};
+    int watched;
+
+    if(arguments.profile != NULL){
+      profile_enabled = 1;
+      profile_begin();
+    }
+
+    if(arguments.command != NULL && arguments.file_count == 0){
+      printf("Usage: quack %s [OPTION...] %s\nTry `quack --help' or `quack --usage' for more information.\n",
+             arguments.command, (strcmp(arguments.command, "merge") == 0)?"FILE...":"MANIFEST");
+      exit(1);
+    }
+
+    if(arguments.command != NULL && strcmp(arguments.command, "batch") == 0){
+      /* Samples are read one file per thread, so use every CPU by default */
+      if(arguments.threads == 0)
+        arguments.threads = (sysconf(_SC_NPROCESSORS_ONLN) > 0)?sysconf(_SC_NPROCESSORS_ONLN):1;
+      if(arguments.adapters != NULL)
+        kmers = read_adapters(arguments.adapters, arguments.kmer_size);
+      for(i = 0; i < arguments.file_count; i++)
+        run_batch(arguments.files[i], kmers, arguments.kmer_size, arguments.threads,
+                  &arguments.sampling, arguments.format);
+      if(kmers) kmer_index_free(kmers);
+      if(arguments.profile != NULL)
+        write_profile(arguments.profile);
+      exit (0);
+    }
+    if(arguments.threads == 0)
+      arguments.threads = 1;
+
+    if(arguments.command != NULL){
+      /* Add up the stats files; they say whether the run was paired and
+         used adapters */
+      for(i = 0; i < arguments.file_count; i++)
+        stats_merge(arguments.files[i], data, &info);
+      paired = (info.sections == 2);
+      files[0] = (paired)?"forward":"unpaired";
+      files[1] = "reverse";
+    }else{
+      paired = (arguments.forward != NULL && arguments.reverse != NULL);
+      unpaired = (arguments.unpaired != NULL);
+      adapters = (arguments.adapters != NULL);
+
+      /* If paired and unparied data are both set or unset, then throw error */
+      if(paired == unpaired){
+        printf("%s\n", "Usage: quack [OPTION...]\nTry `quack --help' or `quack --usage' for more information.");
+        exit(1);
+      }
+
+      if(adapters) kmers = read_adapters(arguments.adapters, arguments.kmer_size);
+      info.sections = (paired)?2:1;
+      info.adapters_used = adapters;
+      info.kmer_size = (adapters)?arguments.kmer_size:0;
+      sampling_note(&arguments.sampling, note, sizeof(note));
+      files[0] = (paired)?arguments.forward:arguments.unpaired;
+      files[1] = arguments.reverse;
+
+      live.follow = arguments.follow;
+      live.snapshot = arguments.snapshot;
+      live.every_reads = arguments.snapshot_reads;
+      live.every_seconds = arguments.snapshot_seconds;
+      live.format = arguments.format;
+      live.files = files;
+      live.info = info;
+      live.name = arguments.name;
+      live.note = note;
+      live.checkpoint = arguments.checkpoint;
+      live.checkpoint_seconds = arguments.checkpoint_seconds;
+      live.settings.skip = arguments.sampling.skip;
+      live.settings.max_reads = arguments.sampling.max_reads;
+      live.settings.seed = arguments.sampling.seed;
+      live.settings.fraction = arguments.sampling.fraction;
+      pthread_mutex_init(&live.lock, NULL);
+
+      /* Pick up where an earlier run left off. Files the checkpoint has not
+         reached yet start out empty */
+      if(live.checkpoint != NULL){
+        if(checkpoint_read(live.checkpoint, live.resumed, &info, (kmers != NULL)?kmers->adapters:0,
+                           (kmers != NULL)?kmers->names:NULL, files, live.positions, &live.settings))
+          fprintf(stderr, "quack: resuming from %s\n", live.checkpoint);
+        for(i = 0; i < info.sections; i++){
+          read_tally empty;
+          tally_init(&empty);
+          live.saved[i] = (live.resumed[i] != NULL)?sequence_data_copy(live.resumed[i])
+                                                   :tally_data(&empty, kmers);
+        }
+      }
+      watched = (live.follow > 0 || live.snapshot != NULL || live.checkpoint != NULL);
+
+      /* In paired mode both files are read at the same time, splitting the
+         tally threads between them */
+      if(paired){
+        pthread_t forward_thread;
+        ingest_job forward = {arguments.forward, kmers, (arguments.threads+1)/2,
+                              &arguments.sampling, NULL, 0, NULL};
+        forward.live = (watched)?&live:NULL;
+        pthread_create(&forward_thread, NULL, ingest_run, &forward);
+        data[1] = read_fastq(arguments.reverse, kmers,
+                             (arguments.threads > 1)?arguments.threads/2:1, &arguments.sampling,
+                             forward.live, 1);
+        pthread_join(forward_thread, NULL);
+        data[0] = forward.data;
+      }else{
+        data[0] = read_fastq(arguments.unpaired, kmers, arguments.threads, &arguments.sampling,
+                             (watched)?&live:NULL, 0);
+      }
+
+      /* The last snapshot is the full report */
+      if(live.snapshot != NULL){
+        for(i = 0; i < info.sections; i++){
+          if(live.latest[i] != NULL)
+            sequence_data_free(live.latest[i]);
+          live.latest[i] = sequence_data_copy(data[i]);
+        }
+        live_write(&live);
+        for(i = 0; i < info.sections; i++)
+          sequence_data_free(live.latest[i]);
+      }
+      if(live.checkpoint != NULL){
+        for(i = 0; i < info.sections; i++)
+          sequence_data_free(live.saved[i]);
+        /* The checkpoint's adapter names are shared by its sections */
+        if(live.resumed[0] != NULL){
+          for(i = 0; i < live.resumed[0]->adapters; i++)
+            free(live.resumed[0]->adapter_names[i]);
+          free(live.resumed[0]->adapter_names);
+        }
+        for(i = 0; i < info.sections; i++)
+          if(live.resumed[i] != NULL)
+            sequence_data_free(live.resumed[i]);
+      }
+      pthread_mutex_destroy(&live.lock);
+    }
+
+    write_report(stdout, arguments.format, data, files, &info, arguments.name, note);
+    if(arguments.profile != NULL){
+      fflush(stdout);
+      write_profile(arguments.profile);
+    }
+
+    /* Done, so a rerun starts over */
+    if(arguments.command == NULL && arguments.checkpoint != NULL)
+      unlink(arguments.checkpoint);
+
+    if(kmers) kmer_index_free(kmers);
     exit (0);
 }
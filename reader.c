@@ -0,0 +1,1050 @@
+#include "reader.h"
+#include "deflate.h"
+#include "profile.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+/* Size of the compressed input buffer; must hold at least one BGZF block */
+#define INPUT_BUFFER   (1 << 20)
+/* Size of each decompressed chunk produced by the read-ahead thread */
+#define CHUNK_SIZE     (1 << 20)
+/* BGZF blocks never inflate to more than 64 KB */
+#define BGZF_MAX_BLOCK 65536
+/* Other gzip files are split into pieces of this many compressed bytes, to
+   be inflated in parallel. Each must fit in the input buffer. */
+#define GZIP_PIECE     INPUT_BUFFER
+/* How often a followed file is checked for more data, in milliseconds */
+#define FOLLOW_POLL    100
+/* Restart points kept for checkpoints, at least this many uncompressed bytes
+   apart. Enough are kept to cover the read-ahead chunks and kseq's buffer */
+#define RESTART_POINTS  16
+#define RESTART_SPACING (1 << 20)
+
+enum { FORMAT_PLAIN, FORMAT_GZIP, FORMAT_BGZF, FORMAT_ZSTD };
+
+/* First four bytes of a zstd frame, read little endian */
+#define ZSTD_FRAME_MAGIC 0xFD2FB528
+enum { CHUNK_FREE, CHUNK_LOADED, CHUNK_DONE };
+
+/* What the calling thread is in the middle of, inflating a piece of gzip
+   itself */
+enum { SERIAL_NONE, SERIAL_HEADER, SERIAL_BLOCKS, SERIAL_TRAILER, SERIAL_NEXT };
+
+/* A unit of decompressed output. For BGZF a chunk is one block: the raw block
+   is loaded into `compressed` and a worker inflates it into `data`. For
+   other gzip, `compressed` is a piece of the file followed by the next one,
+   `last` if that runs to the end; a worker decodes it into `part` (see
+   deflate.h) and the calling thread turns that into `data`, `capacity`
+   bytes long. Otherwise the read-ahead thread fills `data` directly. */
+typedef struct {
+  unsigned char *compressed;
+  size_t compressed_size;
+  uint64_t offset;
+  unsigned char *data;
+  size_t size, capacity;
+  int state;
+  int error, last;
+  deflate_part part;
+} input_chunk;
+
+struct input_stream {
+  const char *path;
+  int fd, format, follow;
+
+  /* Raw bytes read from `fd`, and how far into the file they reach */
+  unsigned char *in;
+  size_t in_start, in_end;
+  int in_eof;
+  uint64_t in_offset;
+
+  /* Serial inflate state. A member restarted part way through is `raw`
+     deflate, without its gzip header */
+  z_stream zs;
+  int member_done, raw;
+  uint64_t total_out;
+#ifdef HAVE_ZSTD
+  ZSTD_DStream *zstd;
+#endif
+
+  /* Background decompression; `threads` == 0 means decompress inline */
+  int threads;
+  pthread_t *ids;
+  input_chunk *chunks;
+  int number_of_chunks;
+  uint64_t loaded, dispatched, consumed;
+  int finished, shutdown;
+  pthread_mutex_t lock;
+  pthread_cond_t work, done;
+
+  /* Chunk currently being handed out by input_read */
+  unsigned char *out;
+  size_t out_pos, out_size;
+  uint64_t delivered;
+
+  /* Ring of restart points, NULL unless opened resumable. Guarded by `lock`
+     with background threads */
+  int resumable;
+  input_point *points;
+  int points_used, point_next;
+  uint64_t last_point;
+
+  /* Gzip inflated in pieces. The output so far ends at file bit `bit`, a
+     `bit_kind` place (see deflate.h), and `window` ends with its last
+     `window_length` bytes. `crc` and `member_length` cover the member's
+     output so far, unless it was restarted part way (`crc_known`). A piece
+     whose part doesn't start at `bit` is inflated by `zs` instead, in
+     `serial` state from file byte `serial_at`. `pending` is set while the
+     latest piece waits for the one after it. */
+  int speculative, pending;
+  uint64_t bit, serial_at;
+  int bit_kind, serial;
+  unsigned char *window;
+  size_t window_length;
+  uint32_t crc, member_length;
+  int crc_known;
+};
+
+
+static void fail(input_stream *in, const char *message){
+  fprintf(stderr, "quack: %s: %s\n", in->path, message);
+  exit(1);
+}
+
+/* Whether input_close is waiting for the background threads */
+static int stopping(input_stream *in){
+  int shutdown;
+
+  if(in->threads == 0) return 0;
+  pthread_mutex_lock(&in->lock);
+  shutdown = in->shutdown;
+  pthread_mutex_unlock(&in->lock);
+  return shutdown;
+}
+
+/* Make sure at least `wanted` unread bytes are buffered, unless the file ends
+   first. A followed file only ends once it has stopped growing. Returns the
+   number of unread bytes. */
+static size_t fill_input(input_stream *in, size_t wanted){
+  struct timespec poll = {0, FOLLOW_POLL*1000000L};
+  profile_timer timer;
+  ssize_t n;
+  int idle = 0;
+
+  if(in->in_end - in->in_start >= wanted)
+    return in->in_end - in->in_start;
+
+  if(in->in_start == in->in_end){
+    in->in_start = in->in_end = 0;
+  }else if(in->in_start + wanted > INPUT_BUFFER){
+    memmove(in->in, in->in + in->in_start, in->in_end - in->in_start);
+    in->in_end -= in->in_start;
+    in->in_start = 0;
+  }
+
+  while(!in->in_eof && in->in_end - in->in_start < wanted){
+    if(profile_enabled) profile_start(&timer);
+    n = read(in->fd, in->in + in->in_end, INPUT_BUFFER - in->in_end);
+    if(profile_enabled) profile_stop(PROFILE_READ, &timer);
+    if(n < 0){
+      if(errno == EINTR) continue;
+      fail(in, strerror(errno));
+    }
+    if(n == 0){
+      if(idle < in->follow*(1000/FOLLOW_POLL) && !stopping(in)){
+        nanosleep(&poll, NULL);
+        idle++;
+        continue;
+      }
+      in->in_eof = 1;
+    }
+    idle = 0;
+    in->in_end += n;
+    in->in_offset += n;
+    if(profile_enabled) profile_count(PROFILE_BYTES_COMPRESSED, n);
+  }
+
+  return in->in_end - in->in_start;
+}
+
+static uint32_t le32(const unsigned char *p){
+  return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/* Offset in the file of the next unread raw byte */
+static uint64_t input_position(input_stream *in){
+  return in->in_offset - (in->in_end - in->in_start);
+}
+
+/* Keep a restart point at uncompressed byte `offset`, file byte `compressed`.
+   Inside a gzip member, `bits` and the inflate window are kept as well. */
+static void add_point(input_stream *in, uint64_t offset, uint64_t compressed, int bits, int window){
+  input_point *point;
+  uInt length = 0;
+
+  if(in->points_used > 0 && offset - in->last_point < RESTART_SPACING)
+    return;
+  if(in->threads > 0) pthread_mutex_lock(&in->lock);
+  point = &in->points[in->point_next];
+  in->point_next = (in->point_next + 1) % RESTART_POINTS;
+  if(in->points_used < RESTART_POINTS) in->points_used++;
+  point->offset = offset;
+  point->compressed = compressed;
+  point->bits = bits;
+  if(window && in->speculative){
+    length = in->window_length;
+    memcpy(point->window, in->window + DEFLATE_WINDOW - length, length);
+  }else if(window){
+    inflateGetDictionary(&in->zs, point->window, &length);
+  }
+  point->window_length = length;
+  if(in->threads > 0) pthread_mutex_unlock(&in->lock);
+  in->last_point = offset;
+}
+
+
+/*************** Serial decompression ***************/
+
+#ifdef HAVE_ZSTD
+/* Decompress up to `length` bytes of zstd into `out`; following frames are
+   picked up by the same stream. Returns 0 at end of file. */
+static size_t read_zstd(input_stream *in, unsigned char *out, size_t length){
+  ZSTD_inBuffer input;
+  ZSTD_outBuffer output = {out, length, 0};
+  size_t available, before, ret;
+  profile_timer timer;
+
+  while(output.pos < length){
+    available = fill_input(in, 1);
+    input.src  = in->in + in->in_start;
+    input.size = available;
+    input.pos  = 0;
+    before = output.pos;
+    if(profile_enabled) profile_start(&timer);
+    ret = ZSTD_decompressStream(in->zstd, &output, &input);
+    if(profile_enabled) profile_stop(PROFILE_INFLATE, &timer);
+    if(ZSTD_isError(ret))
+      fail(in, ZSTD_getErrorName(ret));
+    in->in_start += input.pos;
+
+    /* With no input left the decoder may still hold output. Once it has
+       none, the file must have ended on a frame boundary */
+    if(available == 0 && output.pos == before){
+      if(!in->member_done)
+        fail(in, "unexpected end of file");
+      break;
+    }
+    in->member_done = (ret == 0);
+  }
+
+  return output.pos;
+}
+#endif
+
+/* Decompress (or copy, for plain text) up to `length` bytes into `out`.
+   Returns 0 at end of file. */
+static size_t read_serial(input_stream *in, unsigned char *out, size_t length){
+  size_t produced = 0, available;
+  profile_timer timer;
+  int ret;
+
+  if(in->format == FORMAT_PLAIN){
+    while(produced < length){
+      available = fill_input(in, 1);
+      if(available == 0) break;
+      if(available > length - produced) available = length - produced;
+      memcpy(out + produced, in->in + in->in_start, available);
+      in->in_start += available;
+      produced += available;
+    }
+    return produced;
+  }
+
+#ifdef HAVE_ZSTD
+  if(in->format == FORMAT_ZSTD)
+    return read_zstd(in, out, length);
+#endif
+
+  while(produced < length){
+    if(in->member_done){
+      /* Another gzip member may follow. Anything else after a member is
+         ignored, the same as gzread does */
+      if(fill_input(in, 2) < 2
+         || in->in[in->in_start] != 0x1f || in->in[in->in_start+1] != 0x8b)
+        break;
+      if(in->points != NULL)
+        add_point(in, in->total_out + produced, input_position(in), 0, 0);
+      inflateReset2(&in->zs, 15 + 16);
+      in->member_done = 0;
+    }
+
+    if(fill_input(in, 1) == 0)
+      fail(in, "unexpected end of file");
+
+    in->zs.next_in   = in->in + in->in_start;
+    in->zs.avail_in  = in->in_end - in->in_start;
+    in->zs.next_out  = out + produced;
+    in->zs.avail_out = length - produced;
+    /* With restart points, stop at each deflate block so its end can be
+       one */
+    if(profile_enabled) profile_start(&timer);
+    ret = inflate(&in->zs, (in->points != NULL)?Z_BLOCK:Z_NO_FLUSH);
+    if(profile_enabled) profile_stop(PROFILE_INFLATE, &timer);
+    produced = length - in->zs.avail_out;
+    in->in_start = in->in_end - in->zs.avail_in;
+
+    if(ret == Z_STREAM_END){
+      /* Raw deflate leaves the member's trailer unread */
+      if(in->raw){
+        if(fill_input(in, 8) < 8)
+          fail(in, "unexpected end of file");
+        in->in_start += 8;
+        in->raw = 0;
+      }
+      in->member_done = 1;
+    }else if(ret != Z_OK && ret != Z_BUF_ERROR){
+      fail(in, (in->zs.msg != NULL)?in->zs.msg:"invalid gzip data");
+    }else if(in->points != NULL && (in->zs.data_type & 128) && !(in->zs.data_type & 64)){
+      /* End of a block that is not the last of its member */
+      add_point(in, in->total_out + produced, input_position(in), in->zs.data_type & 7, 1);
+    }
+  }
+
+  in->total_out += produced;
+  return produced;
+}
+
+/* Read-ahead thread: decompress the stream into the chunk ring so
+   decompressing overlaps with parsing in the calling thread. Used for zstd
+   and plain text; gzip is inflated by several threads instead */
+static void* readahead_worker(void *arg){
+  input_stream *in = arg;
+  input_chunk *chunk;
+  size_t size;
+
+  pthread_mutex_lock(&in->lock);
+  for(;;){
+    while(!in->shutdown && !in->finished
+          && in->loaded - in->consumed == in->number_of_chunks)
+      pthread_cond_wait(&in->work, &in->lock);
+    if(in->shutdown || in->finished) break;
+
+    chunk = &in->chunks[in->loaded % in->number_of_chunks];
+    pthread_mutex_unlock(&in->lock);
+
+    size = read_serial(in, chunk->data, CHUNK_SIZE);
+
+    pthread_mutex_lock(&in->lock);
+    chunk->size = size;
+    chunk->state = CHUNK_DONE;
+    in->loaded++;
+    if(size == 0) in->finished = 1;
+    pthread_cond_broadcast(&in->done);
+  }
+  pthread_mutex_unlock(&in->lock);
+
+  profile_flush();
+  return NULL;
+}
+
+
+/*************** BGZF ***************/
+
+/* BGZF is gzip with the compressed size of each member stored in a 'BC' extra
+   subfield, so members can be located without inflating and decompressed
+   independently. */
+static int is_bgzf(const unsigned char *header, size_t length){
+  return length >= 18
+    && header[0] == 0x1f && header[1] == 0x8b && header[2] == 8
+    && (header[3] & 4)
+    && header[12] == 'B' && header[13] == 'C'
+    && header[14] == 2 && header[15] == 0;
+}
+
+/* Copy the next BGZF block into `chunk`. Returns 0 at end of file. */
+static int load_block(input_stream *in, input_chunk *chunk){
+  const unsigned char *header;
+  size_t available, xlen, i, block_size = 0;
+
+  available = fill_input(in, 12);
+  if(available == 0) return 0;
+
+  header = in->in + in->in_start;
+  if(available < 12 || header[0] != 0x1f || header[1] != 0x8b || !(header[3] & 4))
+    fail(in, "BGZF block without extra field");
+
+  xlen = header[10] | header[11] << 8;
+  if(fill_input(in, 12 + xlen) < 12 + xlen)
+    fail(in, "truncated BGZF block");
+
+  /* Look for the 'BC' subfield holding the block size minus one */
+  header = in->in + in->in_start;
+  for(i = 12; i + 4 <= 12 + xlen; i += 4 + (header[i+2] | header[i+3] << 8)){
+    if(header[i] == 'B' && header[i+1] == 'C' && header[i+2] == 2 && header[i+3] == 0){
+      block_size = (header[i+4] | header[i+5] << 8) + 1;
+      break;
+    }
+  }
+  if(block_size < 12 + xlen + 8)
+    fail(in, "BGZF block without size");
+
+  if(fill_input(in, block_size) < block_size)
+    fail(in, "truncated BGZF block");
+
+  memcpy(chunk->compressed, in->in + in->in_start, block_size);
+  chunk->compressed_size = block_size;
+  chunk->offset = input_position(in);
+  in->in_start += block_size;
+
+  return 1;
+}
+
+static void inflate_block(z_stream *zs, input_chunk *chunk){
+  const unsigned char *block = chunk->compressed;
+  size_t size = chunk->compressed_size;
+  size_t xlen = block[10] | block[11] << 8;
+  uint32_t isize = le32(block + size - 4);
+
+  chunk->error = 0;
+  chunk->size = isize;
+  if(isize > BGZF_MAX_BLOCK){
+    chunk->error = 1;
+    return;
+  }
+
+  inflateReset(zs);
+  zs->next_in   = (unsigned char*)block + 12 + xlen;
+  zs->avail_in  = size - 12 - xlen - 8;
+  zs->next_out  = chunk->data;
+  zs->avail_out = BGZF_MAX_BLOCK;
+
+  if(inflate(zs, Z_FINISH) != Z_STREAM_END
+     || zs->total_out != isize
+     || crc32(0, chunk->data, isize) != le32(block + size - 8))
+    chunk->error = 1;
+}
+
+/* Inflate worker: take loaded BGZF blocks or gzip pieces in file order and
+   decompress them */
+static void* inflate_worker(void *arg){
+  input_stream *in = arg;
+  input_chunk *chunk;
+  profile_timer timer;
+  z_stream zs;
+
+  memset(&zs, 0, sizeof(zs));
+  inflateInit2(&zs, -15);
+
+  pthread_mutex_lock(&in->lock);
+  for(;;){
+    while(!in->shutdown && in->dispatched == in->loaded)
+      pthread_cond_wait(&in->work, &in->lock);
+    if(in->shutdown) break;
+
+    chunk = &in->chunks[in->dispatched % in->number_of_chunks];
+    in->dispatched++;
+    pthread_mutex_unlock(&in->lock);
+
+    if(profile_enabled) profile_start(&timer);
+    if(in->speculative)
+      chunk->error = !deflate_decode_part(chunk->compressed, chunk->compressed_size, chunk->last,
+                                          (uint64_t)GZIP_PIECE*8, &chunk->part);
+    else
+      inflate_block(&zs, chunk);
+    if(profile_enabled) profile_stop(PROFILE_INFLATE, &timer);
+
+    pthread_mutex_lock(&in->lock);
+    chunk->state = CHUNK_DONE;
+    pthread_cond_broadcast(&in->done);
+  }
+  pthread_mutex_unlock(&in->lock);
+
+  inflateEnd(&zs);
+  profile_flush();
+  return NULL;
+}
+
+/* Load a block into a free chunk and hand it to the inflate workers */
+static void queue_block(input_stream *in, input_chunk *chunk){
+  if(!load_block(in, chunk)){
+    in->finished = 1;
+    return;
+  }
+  pthread_mutex_lock(&in->lock);
+  chunk->state = CHUNK_LOADED;
+  in->loaded++;
+  pthread_cond_signal(&in->work);
+  pthread_mutex_unlock(&in->lock);
+}
+
+
+/*************** Gzip pieces ***************/
+
+/* Gzip without BGZF's block sizes is inflated by guessing where in each
+   piece deflate data starts and decoding from there without the output
+   before it (see deflate.h). This thread joins the parts up in order and
+   checks each member's CRC and length; a part that turns out not to follow
+   on from the one before is inflated here with zlib. */
+
+/* Read the next piece of the file into a free chunk, add it to the end of
+   the chunk before and hand that one to the workers */
+static void queue_piece(input_stream *in){
+  input_chunk *chunk = &in->chunks[(in->loaded + in->pending) % in->number_of_chunks];
+  input_chunk *waiting = &in->chunks[in->loaded % in->number_of_chunks];
+  size_t size = fill_input(in, GZIP_PIECE);
+
+  if(size > GZIP_PIECE) size = GZIP_PIECE;
+  chunk->offset = input_position(in);
+  chunk->compressed_size = size;
+  memcpy(chunk->compressed, in->in + in->in_start, size);
+  in->in_start += size;
+
+  if(in->pending){
+    memcpy(waiting->compressed + waiting->compressed_size, chunk->compressed, size);
+    waiting->compressed_size += size;
+    waiting->last = (fill_input(in, 1) == 0);
+    pthread_mutex_lock(&in->lock);
+    waiting->state = CHUNK_LOADED;
+    in->loaded++;
+    pthread_cond_signal(&in->work);
+    pthread_mutex_unlock(&in->lock);
+  }
+  in->pending = (size > 0);
+  if(size == 0) in->finished = 1;
+}
+
+/* Make room for `size` bytes of output in `chunk` */
+static void reserve_output(input_chunk *chunk, size_t size){
+  if(size <= chunk->capacity) return;
+  chunk->capacity = (size > 2*chunk->capacity)?size:2*chunk->capacity;
+  chunk->data = realloc(chunk->data, chunk->capacity);
+}
+
+/* Keep the last DEFLATE_WINDOW bytes of output, at the end of `window` */
+static void keep_window(input_stream *in, const unsigned char *data, size_t size){
+  if(size >= DEFLATE_WINDOW){
+    memcpy(in->window, data + size - DEFLATE_WINDOW, DEFLATE_WINDOW);
+    in->window_length = DEFLATE_WINDOW;
+    return;
+  }
+  memmove(in->window, in->window + size, DEFLATE_WINDOW - size);
+  memcpy(in->window + DEFLATE_WINDOW - size, data, size);
+  in->window_length += size;
+  if(in->window_length > DEFLATE_WINDOW) in->window_length = DEFLATE_WINDOW;
+}
+
+static void start_member(input_stream *in){
+  in->crc = crc32(0L, Z_NULL, 0);
+  in->member_length = 0;
+  in->crc_known = 1;
+}
+
+static void add_output(input_stream *in, const unsigned char *data, size_t size){
+  in->crc = crc32(in->crc, data, size);
+  in->member_length += size;
+}
+
+/* Check the trailer of the member just inflated */
+static void end_member(input_stream *in, uint32_t crc, uint32_t length){
+  if(!in->crc_known) return;
+  if(crc != in->crc)
+    fail(in, "incorrect data check");
+  if(length != in->member_length)
+    fail(in, "incorrect length check");
+}
+
+/* Fill in the bytes of the window the chunk's part refers back to */
+static void resolve_part(input_stream *in, input_chunk *chunk){
+  const deflate_part *part = &chunk->part;
+  size_t i, from = 0, missing = DEFLATE_WINDOW - in->window_length;
+  unsigned symbol;
+
+  reserve_output(chunk, part->length);
+  for(i = 0; i < part->length; i++){
+    symbol = part->symbols[i];
+    if(symbol >= 256){
+      if(symbol - DEFLATE_MARKER < missing)
+        fail(in, "invalid distance too far back");
+      symbol = in->window[symbol - DEFLATE_MARKER];
+    }
+    chunk->data[i] = symbol;
+  }
+
+  if(part->start_kind == DEFLATE_MEMBER) start_member(in);
+  for(i = 0; i < part->ends_used; i++){
+    add_output(in, chunk->data + from, part->ends[i].output - from);
+    end_member(in, part->ends[i].crc, part->ends[i].size);
+    start_member(in);
+    from = part->ends[i].output;
+  }
+  add_output(in, chunk->data + from, part->length - from);
+
+  chunk->size = part->length;
+  in->bit = chunk->offset*8 + part->end;
+  in->bit_kind = part->end_kind;
+}
+
+/* Inflate the chunk's piece with zlib, from `bit` or from where the piece
+   before stopped, to the first place at or after the end of the piece that
+   deflate_decode_part would stop at. Runs on into the next piece if the
+   chunk's data runs out first. */
+static void inflate_piece(input_stream *in, input_chunk *chunk){
+  const unsigned char *data = chunk->compressed;
+  size_t size = chunk->compressed_size, at, produced = 0, n;
+  uint64_t to = (chunk->offset + GZIP_PIECE)*8, bit;
+  long header;
+  int ret;
+
+  if(in->serial != SERIAL_NONE){
+    at = in->serial_at - chunk->offset;
+  }else if(in->bit_kind == DEFLATE_MEMBER){
+    at = in->bit/8 - chunk->offset;
+    in->serial = SERIAL_HEADER;
+  }else{
+    /* Carry on as raw deflate from the bits left in the byte and the window
+       of earlier output */
+    at = in->bit/8 - chunk->offset;
+    inflateReset2(&in->zs, -15);
+    if(in->bit % 8 != 0)
+      inflatePrime(&in->zs, 8 - in->bit % 8, data[at++] >> (in->bit % 8));
+    inflateSetDictionary(&in->zs, in->window + DEFLATE_WINDOW - in->window_length, in->window_length);
+    in->serial = SERIAL_BLOCKS;
+  }
+
+  for(;;){
+    if(in->serial == SERIAL_HEADER){
+      bit = (chunk->offset + at)*8;
+      if(bit >= to){
+        in->bit_kind = DEFLATE_MEMBER;
+        break;
+      }
+      header = deflate_gzip_header(data + at, size - at);
+      if(header < 0)
+        fail(in, "invalid gzip header");
+      if(header == 0)
+        goto out_of_data;
+      at += header;
+      inflateReset2(&in->zs, -15);
+      start_member(in);
+      in->serial = SERIAL_BLOCKS;
+
+      /* The member's first block may be where the next part starts */
+      bit = (chunk->offset + at)*8;
+      if(bit >= to && deflate_dynamic_start(data, size, bit - chunk->offset*8)){
+        in->bit_kind = DEFLATE_BLOCK;
+        break;
+      }
+    }else if(in->serial == SERIAL_BLOCKS){
+      reserve_output(chunk, produced + CHUNK_SIZE);
+      in->zs.next_in   = (unsigned char*)data + at;
+      in->zs.avail_in  = size - at;
+      in->zs.next_out  = chunk->data + produced;
+      in->zs.avail_out = chunk->capacity - produced;
+      ret = inflate(&in->zs, Z_BLOCK);
+      n = chunk->capacity - produced - in->zs.avail_out;
+      add_output(in, chunk->data + produced, n);
+      produced += n;
+      at = size - in->zs.avail_in;
+
+      if(ret == Z_STREAM_END){
+        in->serial = SERIAL_TRAILER;
+      }else if(ret != Z_OK && ret != Z_BUF_ERROR){
+        fail(in, (in->zs.msg != NULL)?in->zs.msg:"invalid gzip data");
+      }else if(in->zs.data_type & 128){
+        /* Between blocks, where the next part may start */
+        bit = (chunk->offset + at)*8 - (in->zs.data_type & 7);
+        if(bit >= to && deflate_dynamic_start(data, size, bit - chunk->offset*8)){
+          in->bit_kind = DEFLATE_BLOCK;
+          break;
+        }
+      }else if(in->zs.avail_in == 0 && in->zs.avail_out > 0){
+        goto out_of_data;
+      }
+    }else if(in->serial == SERIAL_TRAILER){
+      if(size - at < 8)
+        goto out_of_data;
+      end_member(in, le32(data + at), le32(data + at + 4));
+      at += 8;
+      in->serial = SERIAL_NEXT;
+    }else{
+      /* Another member may follow. Anything else after a member is ignored,
+         the same as gzread does */
+      if(size - at < 2 && !chunk->last)
+        goto out_of_data;
+      if(size - at < 2 || data[at] != 0x1f || data[at+1] != 0x8b){
+        bit = (chunk->offset + at)*8;
+        in->bit_kind = DEFLATE_END;
+        break;
+      }
+      in->serial = SERIAL_HEADER;
+    }
+  }
+
+  in->serial = SERIAL_NONE;
+  in->bit = bit;
+  chunk->size = produced;
+  return;
+
+out_of_data:
+  if(chunk->last)
+    fail(in, "unexpected end of file");
+  in->serial_at = chunk->offset + at;
+  chunk->size = produced;
+}
+
+/* Turn the chunk's piece into output, following on from `bit`. Returns 0
+   if the gzip data ended before it. */
+static int join_piece(input_stream *in, input_chunk *chunk){
+  uint64_t start = chunk->offset*8;
+  profile_timer timer;
+
+  chunk->size = 0;
+  if(in->serial == SERIAL_NONE){
+    if(in->bit_kind == DEFLATE_END)
+      return 0;
+    /* Already inflated along with the piece before */
+    if(in->bit >= start + (uint64_t)GZIP_PIECE*8)
+      return 1;
+    if(in->points != NULL)
+      add_point(in, in->delivered, (in->bit + 7)/8, (8 - in->bit % 8) % 8,
+                in->bit_kind == DEFLATE_BLOCK);
+  }
+
+  if(profile_enabled) profile_start(&timer);
+  if(in->serial == SERIAL_NONE && !chunk->error
+     && start + chunk->part.start == in->bit && chunk->part.start_kind == in->bit_kind)
+    resolve_part(in, chunk);
+  else
+    inflate_piece(in, chunk);
+  if(profile_enabled) profile_stop(PROFILE_INFLATE, &timer);
+
+  keep_window(in, chunk->data, chunk->size);
+  return 1;
+}
+
+
+/*************** Chunk ring ***************/
+
+/* Release the chunk being read and wait for the next one. Returns 0 at end of
+   file. */
+static int next_chunk(input_stream *in){
+  input_chunk *chunk;
+  profile_timer timer;
+
+  do {
+    if(in->out != NULL){
+      chunk = &in->chunks[in->consumed % in->number_of_chunks];
+      pthread_mutex_lock(&in->lock);
+      chunk->state = CHUNK_FREE;
+      in->consumed++;
+      pthread_cond_signal(&in->work);
+      pthread_mutex_unlock(&in->lock);
+      in->out = NULL;
+
+      /* BGZF blocks are read by this thread, refill the slot just freed */
+      if(in->format == FORMAT_BGZF && !in->finished)
+        queue_block(in, chunk);
+    }
+    /* So are gzip pieces, one behind the slots in use */
+    while(in->speculative && !in->finished
+          && in->loaded + in->pending - in->consumed < (uint64_t)in->number_of_chunks)
+      queue_piece(in);
+
+    pthread_mutex_lock(&in->lock);
+    if((in->format == FORMAT_BGZF || in->speculative) && in->consumed == in->loaded){
+      pthread_mutex_unlock(&in->lock);
+      return 0;
+    }
+    chunk = &in->chunks[in->consumed % in->number_of_chunks];
+    if(profile_enabled) profile_start(&timer);
+    while(chunk->state != CHUNK_DONE)
+      pthread_cond_wait(&in->done, &in->lock);
+    if(profile_enabled) profile_stop(PROFILE_WAIT, &timer);
+    pthread_mutex_unlock(&in->lock);
+
+    if(chunk->error && in->format == FORMAT_BGZF)
+      fail(in, "corrupt BGZF block");
+    if(in->speculative && !join_piece(in, chunk))
+      return 0;
+    /* An empty chunk is the end of the read-ahead stream; an empty BGZF block
+       (such as the EOF marker) or gzip piece is skipped */
+    if(chunk->size == 0 && in->format != FORMAT_BGZF && !in->speculative)
+      return 0;
+
+    in->out = chunk->data;
+    in->out_pos = 0;
+    in->out_size = chunk->size;
+    if(in->points != NULL && in->format == FORMAT_BGZF && chunk->size > 0)
+      add_point(in, in->delivered, chunk->offset, 0, 0);
+  } while(in->out_size == 0);
+
+  return 1;
+}
+
+
+/*************** Interface ***************/
+
+/* Go back to `start` in a file opened resumable */
+static void restart(input_stream *in, const input_point *start){
+  int inside = (start->bits != 0 || start->window_length != 0);
+  uint64_t position = start->compressed - (start->bits != 0);
+
+  /* BGZF blocks can only be inflated from their start */
+  if(in->format == FORMAT_BGZF && inside){
+    in->format = FORMAT_GZIP;
+    in->speculative = 1;
+  }
+  if(in->format == FORMAT_PLAIN && inside)
+    fail(in, "checkpoint does not match the file");
+
+  if(lseek(in->fd, position, SEEK_SET) < 0)
+    fail(in, strerror(errno));
+  in->in_start = in->in_end = 0;
+  in->in_eof = 0;
+  in->in_offset = position;
+  in->total_out = in->delivered = in->last_point = start->offset;
+
+  /* Inflated in pieces, the first picks up from the point and its window */
+  if(in->speculative){
+    in->bit = start->compressed*8 - start->bits;
+    in->bit_kind = inside?DEFLATE_BLOCK:DEFLATE_MEMBER;
+    in->window_length = start->window_length;
+    memcpy(in->window + DEFLATE_WINDOW - start->window_length, start->window, start->window_length);
+    in->crc_known = 0;
+    return;
+  }
+
+  /* Part way through a member, carry on as raw deflate from the bits left
+     in the byte before and the window of earlier output */
+  if(inside){
+    inflateReset2(&in->zs, -15);
+    if(start->bits != 0){
+      if(fill_input(in, 1) < 1)
+        fail(in, "file is shorter than its checkpoint");
+      inflatePrime(&in->zs, start->bits, in->in[in->in_start++] >> (8 - start->bits));
+    }
+    inflateSetDictionary(&in->zs, start->window, start->window_length);
+    in->raw = 1;
+    in->member_done = 0;
+  }
+}
+
+static input_stream* open_stream(const char *path, int threads, int follow,
+                                 int resumable, const input_point *start){
+  input_stream *in;
+  size_t available;
+  int i;
+
+  in = calloc(1, sizeof(input_stream));
+  in->path = path;
+  in->follow = follow;
+  in->fd = (strcmp(path, "-") == 0)?STDIN_FILENO:open(path, O_RDONLY);
+  if(in->fd < 0){
+    free(in);
+    return NULL;
+  }
+  in->in = malloc(INPUT_BUFFER);
+
+  available = fill_input(in, 18);
+  if(available >= 2 && in->in[0] == 0x1f && in->in[1] == 0x8b){
+    in->format = FORMAT_GZIP;
+    if(threads > 1 && is_bgzf(in->in, available))
+      in->format = FORMAT_BGZF;
+    inflateInit2(&in->zs, 15 + 16);
+    in->member_done = 1;
+    /* With threads, BGZF may also turn into gzip restarting part way */
+    if(threads > 1){
+      in->speculative = (in->format == FORMAT_GZIP);
+      in->window = malloc(DEFLATE_WINDOW);
+    }
+  }else if(available >= 4 && le32(in->in) == ZSTD_FRAME_MAGIC){
+#ifdef HAVE_ZSTD
+    in->format = FORMAT_ZSTD;
+    in->zstd = ZSTD_createDStream();
+    ZSTD_initDStream(in->zstd);
+#else
+    fail(in, "zstd input needs quack built with zstd (make ZSTD=1)");
+#endif
+  }else{
+    in->format = FORMAT_PLAIN;
+  }
+
+  if(resumable){
+    if(in->format == FORMAT_ZSTD)
+      fail(in, "zstd input can't be checkpointed");
+    if(lseek(in->fd, 0, SEEK_CUR) < 0)
+      fail(in, "a pipe can't be checkpointed");
+    in->resumable = 1;
+    if(in->format != FORMAT_PLAIN)
+      in->points = malloc(RESTART_POINTS*sizeof(input_point));
+    if(start != NULL)
+      restart(in, start);
+  }
+
+  if(threads <= 1)
+    return in;
+
+  /* BGZF and gzip use all threads to inflate blocks or pieces; zstd and
+     plain text are read serially so a single read-ahead thread is used */
+  if(in->format == FORMAT_BGZF){
+    in->threads = threads;
+    in->number_of_chunks = 4*threads;
+  }else if(in->speculative){
+    in->threads = threads;
+    in->number_of_chunks = threads + 2;
+  }else{
+    in->threads = 1;
+    in->number_of_chunks = 4;
+  }
+  in->chunks = calloc(in->number_of_chunks, sizeof(input_chunk));
+  for(i = 0; i < in->number_of_chunks; i++){
+    if(in->format == FORMAT_BGZF){
+      in->chunks[i].compressed = malloc(BGZF_MAX_BLOCK);
+      in->chunks[i].data = malloc(BGZF_MAX_BLOCK);
+    }else if(in->speculative){
+      in->chunks[i].compressed = malloc(2*GZIP_PIECE);
+    }else{
+      in->chunks[i].data = malloc(CHUNK_SIZE);
+    }
+  }
+  pthread_mutex_init(&in->lock, NULL);
+  pthread_cond_init(&in->work, NULL);
+  pthread_cond_init(&in->done, NULL);
+
+  in->ids = malloc(in->threads*sizeof(pthread_t));
+  for(i = 0; i < in->threads; i++)
+    pthread_create(&in->ids[i], NULL,
+                   (in->format == FORMAT_BGZF || in->speculative)?inflate_worker:readahead_worker, in);
+
+  if(in->format == FORMAT_BGZF)
+    for(i = 0; i < in->number_of_chunks && !in->finished; i++)
+      queue_block(in, &in->chunks[i]);
+  while(in->speculative && !in->finished && in->loaded + in->pending < (uint64_t)in->number_of_chunks)
+    queue_piece(in);
+
+  return in;
+}
+
+input_stream* input_open(const char *path, int threads, int follow){
+  return open_stream(path, threads, follow, 0, NULL);
+}
+
+input_stream* input_open_resumable(const char *path, int threads, int follow,
+                                   const input_point *start, uint64_t offset){
+  input_stream *in = open_stream(path, threads, follow, 1, start);
+  unsigned char *skip;
+  int n;
+
+  if(in == NULL || start == NULL || offset <= start->offset)
+    return in;
+
+  /* Inflate from the restart point up to `offset` */
+  skip = malloc(CHUNK_SIZE);
+  while(in->delivered < offset){
+    n = input_read(in, skip, (offset - in->delivered < CHUNK_SIZE)?offset - in->delivered:CHUNK_SIZE);
+    if(n == 0)
+      fail(in, "file is shorter than its checkpoint");
+  }
+  free(skip);
+  return in;
+}
+
+int input_read(input_stream *in, void *buffer, unsigned int length){
+  size_t copied = 0, n;
+
+  if(in->threads == 0){
+    n = read_serial(in, buffer, length);
+    in->delivered += n;
+    if(profile_enabled) profile_count(PROFILE_BYTES_UNCOMPRESSED, n);
+    return n;
+  }
+
+  while(copied < length){
+    if(in->out == NULL || in->out_pos == in->out_size){
+      if(!next_chunk(in)) break;
+    }
+    n = in->out_size - in->out_pos;
+    if(n > length - copied) n = length - copied;
+    memcpy((char*)buffer + copied, in->out + in->out_pos, n);
+    in->out_pos += n;
+    in->delivered += n;
+    copied += n;
+  }
+
+  if(profile_enabled) profile_count(PROFILE_BYTES_UNCOMPRESSED, copied);
+  return copied;
+}
+
+uint64_t input_tell(input_stream *in){
+  return in->delivered;
+}
+
+int input_restart_point(input_stream *in, uint64_t offset, input_point *point){
+  const input_point *best = NULL;
+  int i;
+
+  if(!in->resumable)
+    return 0;
+  if(in->format == FORMAT_PLAIN){
+    point->offset = point->compressed = offset;
+    point->bits = point->window_length = 0;
+    return 1;
+  }
+
+  if(in->threads > 0) pthread_mutex_lock(&in->lock);
+  for(i = 0; i < in->points_used; i++)
+    if(in->points[i].offset <= offset && (best == NULL || in->points[i].offset > best->offset))
+      best = &in->points[i];
+  if(best != NULL)
+    *point = *best;
+  if(in->threads > 0) pthread_mutex_unlock(&in->lock);
+  return best != NULL;
+}
+
+void input_close(input_stream *in){
+  int i;
+
+  if(in->threads > 0){
+    pthread_mutex_lock(&in->lock);
+    in->shutdown = 1;
+    pthread_cond_broadcast(&in->work);
+    pthread_mutex_unlock(&in->lock);
+    for(i = 0; i < in->threads; i++)
+      pthread_join(in->ids[i], NULL);
+
+    for(i = 0; i < in->number_of_chunks; i++){
+      free(in->chunks[i].compressed);
+      free(in->chunks[i].data);
+      deflate_part_free(&in->chunks[i].part);
+    }
+    free(in->chunks);
+    free(in->ids);
+    pthread_mutex_destroy(&in->lock);
+    pthread_cond_destroy(&in->work);
+    pthread_cond_destroy(&in->done);
+  }
+
+  if(in->format == FORMAT_GZIP || in->format == FORMAT_BGZF)
+    inflateEnd(&in->zs);
+#ifdef HAVE_ZSTD
+  if(in->format == FORMAT_ZSTD)
+    ZSTD_freeDStream(in->zstd);
+#endif
+  if(in->fd != STDIN_FILENO)
+    close(in->fd);
+  free(in->points);
+  free(in->window);
+  free(in->in);
+  free(in);
+}
@@ -0,0 +1,60 @@
+#ifndef __READER_H
+#define __READER_H
+
+#include <stdint.h>
+
+/* Sequential byte stream over a FASTQ/FASTA file. Plain text, gzip
+   (including multi-member files), BGZF and, when built with HAVE_ZSTD, zstd
+   are recognised from the first bytes of the file. The file is only read
+   front to back, so named pipes work too. */
+typedef struct input_stream input_stream;
+
+/* Place a stream can be restarted from, for checkpoints. Reading restarts at
+   byte `compressed` of the file, which is uncompressed byte `offset`. Inside
+   a gzip member, the first `bits` bits come from the byte before, and
+   `window` holds the last `window_length` bytes of output, which deflate
+   may refer back to. */
+#define INPUT_WINDOW 32768
+typedef struct {
+  uint64_t offset, compressed;
+  uint32_t bits, window_length;
+  unsigned char window[INPUT_WINDOW];
+} input_point;
+
+/* Open `path` for reading, "-" for standard input. Returns NULL if the file
+   can't be opened.
+     - `threads` = decompression threads. With more than one thread, BGZF
+                   blocks and pieces of other gzip files are inflated in
+                   parallel, and zstd and plain text are read ahead by a
+                   thread.
+     - `follow`  = at the end of the file, wait for it to grow until it has
+                   not for this many seconds. 0 to stop at the end.
+ */
+input_stream* input_open(const char *path, int threads, int follow);
+
+/* As input_open, but also keep points to restart from (see
+   input_restart_point). With `start`, reading begins there and skips on to
+   uncompressed byte `offset`. The file must be seekable and not zstd, or
+   the program ends. */
+input_stream* input_open_resumable(const char *path, int threads, int follow,
+                                   const input_point *start, uint64_t offset);
+
+/* Copy up to `length` uncompressed bytes into `buffer`. Same contract as
+   gzread: returns the number of bytes copied, 0 at end of file. Corrupt or
+   truncated input is reported on stderr and ends the program. */
+int input_read(input_stream *in, void *buffer, unsigned int length);
+
+/* Uncompressed bytes handed out by input_read so far, counting from the
+   start of the file */
+uint64_t input_tell(input_stream *in);
+
+/* Copy the latest restart point at or before uncompressed byte `offset` into
+   `point`. Returns 0 if none is kept, such as for a stream not opened with
+   input_open_resumable. */
+int input_restart_point(input_stream *in, uint64_t offset, input_point *point);
+
+/* Stop background threads and release the stream */
+void input_close(input_stream *in);
+
+
+#endif
@@ -0,0 +1,241 @@
+#include "stats.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static void fail(const char *path, const char *message) {
+    fprintf(stderr, "quack: %s: %s\n", path, message);
+    exit(1);
+}
+
+static uint64_t padded(uint64_t length) {
+    return (length + 7) & ~(uint64_t)7;
+}
+
+void stats_write(FILE *out, sequence_data **data, const stats_info *info) {
+    static const char zeros[8] = {0};
+    static const uint8_t no_registers[DUPLICATION_REGISTERS] = {0};
+    stats_header header = {STATS_MAGIC, STATS_VERSION, STATS_BYTE_ORDER};
+    uint64_t names_length = 0;
+    int i, adapters = data[0]->adapters;
+
+    for (i = 0; i < adapters; i++)
+        names_length += strlen(data[0]->adapter_names[i]) + 1;
+
+    header.sections = info->sections;
+    header.adapters_used = info->adapters_used;
+    header.adapters = adapters;
+    header.kmer_size = info->kmer_size;
+    header.names_length = padded(names_length);
+    fwrite(&header, sizeof(header), 1, out);
+    for (i = 0; i < adapters; i++)
+        fwrite(data[0]->adapter_names[i], strlen(data[0]->adapter_names[i]) + 1, 1, out);
+    fwrite(zeros, header.names_length - names_length, 1, out);
+
+    for (i = 0; i < info->sections; i++) {
+        const duplication_sketch *sketch = &data[i]->duplication;
+        const overrepresented_summary *summary = &data[i]->overrepresented;
+        stats_section section = {data[i]->number_of_sequences, data[i]->max_length,
+                                 sketch->level, sketch->used, summary->used, summary->evicted};
+        uint64_t k;
+
+        memcpy(section.gc, data[i]->gc, sizeof(section.gc));
+        memcpy(section.mean_quality, data[i]->mean_quality, sizeof(section.mean_quality));
+        fwrite(&section, sizeof(section), 1, out);
+        if (data[i]->max_length > 0) {
+            fwrite(data[i]->bases, sizeof(base_information), data[i]->max_length, out);
+            if (adapters > 0)
+                fwrite(data[i]->adapter_hits, sizeof(uint64_t), data[i]->max_length*adapters, out);
+        }
+        /* Only the sampled sequences are saved, not the empty slots */
+        fwrite((sketch->registers != NULL)?sketch->registers:no_registers, DUPLICATION_REGISTERS, 1, out);
+        for (k = 0; sketch->table != NULL && k < DUPLICATION_SLOTS; k++)
+            if (sketch->table[k].count > 0)
+                fwrite(&sketch->table[k], sizeof(duplication_entry), 1, out);
+        if (summary->used > 0)
+            fwrite(summary->entries, sizeof(overrepresented_entry), summary->used, out);
+    }
+
+    if (fflush(out) != 0 || ferror(out)) {
+        fprintf(stderr, "quack: cannot write stats\n");
+        exit(1);
+    }
+}
+
+/* Grow `data` to `max_length` positions, zeroing the new ones */
+static void grow_data(sequence_data *data, uint64_t max_length) {
+    data->bases = realloc(data->bases, max_length*sizeof(base_information));
+    memset(data->bases + data->max_length, 0, (max_length - data->max_length)*sizeof(base_information));
+    if (data->adapters > 0) {
+        data->adapter_hits = realloc(data->adapter_hits, max_length*data->adapters*sizeof(uint64_t));
+        memset(data->adapter_hits + data->max_length*data->adapters, 0,
+               (max_length - data->max_length)*data->adapters*sizeof(uint64_t));
+    }
+    data->max_length = max_length;
+}
+
+void stats_merge(const char *path, sequence_data **data, stats_info *info) {
+    int fd, i;
+    struct stat st;
+    const char *map, *at, *end, *name;
+    const stats_header *header;
+    const stats_section *section;
+    const uint64_t *from;
+    uint64_t *to, k, n;
+    char **names;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0)
+        fail(path, "cannot open");
+    if ((size_t)st.st_size < sizeof(stats_header))
+        fail(path, "not a quack stats file");
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        fail(path, "cannot map");
+    end = map + st.st_size;
+
+    header = (const stats_header*)map;
+    if (memcmp(header->magic, STATS_MAGIC, 8) != 0)
+        fail(path, "not a quack stats file");
+    if (header->version != STATS_VERSION)
+        fail(path, "written by an incompatible version of quack");
+    if (header->byte_order != STATS_BYTE_ORDER)
+        fail(path, "written on a machine with a different byte order");
+    if (header->sections < 1 || header->sections > 2 ||
+        header->names_length > (uint64_t)(end - map) - sizeof(stats_header))
+        fail(path, "corrupt stats file");
+
+    /* Adapter names, checked against the first file */
+    at = map + sizeof(stats_header);
+    if (data[0] == NULL) {
+        info->sections = header->sections;
+        info->adapters_used = header->adapters_used;
+        info->kmer_size = header->kmer_size;
+        names = calloc(header->adapters + 1, sizeof(char*));
+        for (i = 0; i < info->sections; i++) {
+            data[i] = calloc(1, sizeof(sequence_data));
+            data[i]->adapters = header->adapters;
+            data[i]->adapter_names = names;
+        }
+    } else if (header->sections != info->sections || header->adapters_used != info->adapters_used ||
+               header->kmer_size != info->kmer_size || header->adapters != data[0]->adapters) {
+        fail(path, "made with different settings from the first file");
+    }
+    names = data[0]->adapter_names;
+    for (i = 0, name = at; i < header->adapters; i++, name += strlen(name) + 1) {
+        if (memchr(name, '\0', at + header->names_length - name) == NULL)
+            fail(path, "corrupt stats file");
+        if (names[i] == NULL)
+            names[i] = strdup(name);
+        else if (strcmp(names[i], name) != 0)
+            fail(path, "made with different adapters from the first file");
+    }
+    at += header->names_length;
+
+    for (i = 0; i < info->sections; i++) {
+        sequence_data *d = data[i];
+
+        section = (const stats_section*)at;
+        if ((uint64_t)(end - at) < sizeof(stats_section))
+            fail(path, "truncated stats file");
+        at += sizeof(stats_section);
+        n = section->max_length;
+        if (n > (uint64_t)(end - at)/(sizeof(base_information) + d->adapters*sizeof(uint64_t)))
+            fail(path, "truncated stats file");
+
+        if (n > d->max_length)
+            grow_data(d, n);
+        d->number_of_sequences += section->number_of_sequences;
+        for (k = 0; k < TALLY_GC_BINS; k++)
+            d->gc[k] += section->gc[k];
+        for (k = 0; k < 91; k++)
+            d->mean_quality[k] += section->mean_quality[k];
+
+        /* base_information is all 64-bit counters, so add it as one array */
+        from = (const uint64_t*)at;
+        to = (uint64_t*)d->bases;
+        for (k = 0; k < n*sizeof(base_information)/sizeof(uint64_t); k++)
+            to[k] += from[k];
+        at += n*sizeof(base_information);
+
+        from = (const uint64_t*)at;
+        for (k = 0; k < n*d->adapters; k++)
+            d->adapter_hits[k] += from[k];
+        at += n*d->adapters*sizeof(uint64_t);
+
+        if ((uint64_t)(end - at) < DUPLICATION_REGISTERS ||
+            section->duplication_sampled > ((uint64_t)(end - at) - DUPLICATION_REGISTERS)/sizeof(duplication_entry))
+            fail(path, "truncated stats file");
+        if (section->duplication_level > 63 || section->duplication_sampled > DUPLICATION_SAMPLE)
+            fail(path, "corrupt stats file");
+        /* A sketch that never saw a read stays empty */
+        if (section->number_of_sequences > 0)
+            duplication_add_sample(&d->duplication, (const uint8_t*)at, section->duplication_level,
+                                   (const duplication_entry*)(at + DUPLICATION_REGISTERS),
+                                   section->duplication_sampled);
+        at += DUPLICATION_REGISTERS + section->duplication_sampled*sizeof(duplication_entry);
+
+        if (section->overrepresented_entries > OVERREPRESENTED_COUNTERS)
+            fail(path, "corrupt stats file");
+        if (section->overrepresented_entries > (uint64_t)(end - at)/sizeof(overrepresented_entry))
+            fail(path, "truncated stats file");
+        for (k = 0; k < section->overrepresented_entries; k++) {
+            const overrepresented_entry *e = (const overrepresented_entry*)at + k;
+            if (e->length > DUPLICATION_TRUNCATE || e->seq[e->length] != '\0')
+                fail(path, "corrupt stats file");
+        }
+        overrepresented_add_entries(&d->overrepresented, (const overrepresented_entry*)at,
+                                    section->overrepresented_entries, section->overrepresented_evicted);
+        at += section->overrepresented_entries*sizeof(overrepresented_entry);
+    }
+
+    munmap((void*)map, st.st_size);
+}
+
+void sequence_data_add(sequence_data *data, const sequence_data *more) {
+    const uint64_t *from = (const uint64_t*)more->bases;
+    uint64_t *to, k;
+
+    if (more->max_length > data->max_length)
+        grow_data(data, more->max_length);
+    to = (uint64_t*)data->bases;
+    for (k = 0; k < more->max_length*sizeof(base_information)/sizeof(uint64_t); k++)
+        to[k] += from[k];
+    for (k = 0; k < more->max_length*data->adapters; k++)
+        data->adapter_hits[k] += more->adapter_hits[k];
+    data->number_of_sequences += more->number_of_sequences;
+    for (k = 0; k < TALLY_GC_BINS; k++)
+        data->gc[k] += more->gc[k];
+    for (k = 0; k < 91; k++)
+        data->mean_quality[k] += more->mean_quality[k];
+    duplication_merge(&data->duplication, &more->duplication);
+    overrepresented_merge(&data->overrepresented, &more->overrepresented);
+}
+
+sequence_data* sequence_data_copy(const sequence_data *data) {
+    sequence_data *copy = malloc(sizeof(sequence_data));
+
+    *copy = *data;
+    copy->bases = malloc(data->max_length*sizeof(base_information));
+    memcpy(copy->bases, data->bases, data->max_length*sizeof(base_information));
+    if (data->adapter_hits != NULL) {
+        copy->adapter_hits = malloc(data->max_length*data->adapters*sizeof(uint64_t));
+        memcpy(copy->adapter_hits, data->adapter_hits, data->max_length*data->adapters*sizeof(uint64_t));
+    }
+    duplication_copy(&copy->duplication, &data->duplication);
+    overrepresented_copy(&copy->overrepresented, &data->overrepresented);
+    return copy;
+}
+
+void sequence_data_free(sequence_data *data) {
+    free(data->bases);
+    free(data->adapter_hits);
+    duplication_free(&data->duplication);
+    overrepresented_free(&data->overrepresented);
+    free(data);
+}
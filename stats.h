@@ -0,0 +1,101 @@
+#ifndef __STATS_H
+#define __STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "tally.h"
+
+/* Counts for one FASTQ file */
+typedef struct {
+    base_information *bases;
+    /* Reads per adapter at each position, `adapters` per position. NULL
+       without adapters */
+    uint64_t *adapter_hits;
+    int adapters;
+    char **adapter_names;
+    /* Positions counted, or bins of positions past TALLY_EXACT (see
+       tally_bin) */
+    uint64_t max_length;
+    uint64_t original_max_length;
+    uint64_t number_of_sequences;
+    /* Reads by percentage of G and C bases, and by mean quality column,
+       as in read_tally */
+    uint64_t gc[TALLY_GC_BINS];
+    uint64_t mean_quality[91];
+    /* Sketch of the duplicate reads, see duplication.h */
+    duplication_sketch duplication;
+    /* Most common sequences, see overrepresented.h */
+    overrepresented_summary overrepresented;
+} sequence_data;
+
+/* Raw counts saved by `--format binary`, so runs over shards of a lane can
+   be added together later with `quack merge`.
+
+   Everything is 8-byte aligned and in the byte order of the machine that
+   wrote it, so a file can be mapped and read in place:
+     - stats_header
+     - `names_length` bytes of NUL terminated adapter names, zero padded
+     - for each of `sections` files (forward then reverse when paired):
+         stats_section
+         base_information[max_length]
+         uint64_t adapter_hits[max_length*adapters]
+         uint8_t duplication_registers[DUPLICATION_REGISTERS]
+         duplication_entry duplication_sample[duplication_sampled]
+         overrepresented_entry overrepresented[overrepresented_entries]
+   Version 2 counts positions past TALLY_EXACT in bins, as tally_bin does.
+   Version 3 adds the duplication sketch, version 4 overrepresented
+   sequences, version 5 the per read histograms in stats_section.
+ */
+#define STATS_MAGIC "QUACKBIN"
+#define STATS_VERSION 5
+#define STATS_BYTE_ORDER 0x01020304
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t sections;
+    uint32_t adapters_used;
+    uint32_t adapters;
+    uint32_t kmer_size;
+    uint64_t names_length;
+} stats_header;
+
+typedef struct {
+    uint64_t number_of_sequences;
+    uint64_t max_length;
+    uint64_t duplication_level;
+    uint64_t duplication_sampled;
+    uint32_t overrepresented_entries;
+    uint32_t overrepresented_evicted;
+    uint64_t gc[TALLY_GC_BINS];
+    uint64_t mean_quality[91];
+} stats_section;
+
+/* Settings a stats file was made with, which files must share to be merged */
+typedef struct {
+    int sections;
+    int adapters_used;
+    int kmer_size;
+} stats_info;
+
+/* Write the counts of `info->sections` files to `out` */
+void stats_write(FILE *out, sequence_data **data, const stats_info *info);
+
+/* Add the counts in the stats file `path` to `data`. `data` must hold
+   `info->sections` entries, all NULL before the first file, which then sets
+   `info`. Files that can't be read, or were made with other adapters or
+   k-mer size or a different number of sections, end the program. */
+void stats_merge(const char *path, sequence_data **data, stats_info *info);
+
+/* Add the counts in `more`, which has the same adapters, to `data` */
+void sequence_data_add(sequence_data *data, const sequence_data *more);
+
+/* Copy of `data`, sharing its adapter names */
+sequence_data* sequence_data_copy(const sequence_data *data);
+
+/* Release a sequence_data. Adapter names are not freed. */
+void sequence_data_free(sequence_data *data);
+
+#endif
@@ -6,51 +6,173 @@
 #include <string.h>
 
 #define INDENT "  "
-int _svg_indent_level = 0;
 
+/* The writer's state is per thread, so threads can draw reports at the same
+   time, each to its own output */
+static __thread int _svg_indent_level = 0;
 
-char* svg_attr(const char* name, const char* fmt, ...){
-  char *attr;
-  int retval, length, cur_length;
+/* Everything is written to this buffer and goes out in large chunks, to
+   stdout unless svg_set_output says otherwise. It is allocated on first
+   use. */
+#define SVG_BUFFER_SIZE (1 << 20)
+static __thread char *svg_buffer = NULL;
+static __thread size_t svg_buffer_length = 0;
+static __thread FILE *svg_output = NULL;
+
+/* Attributes are formatted into an arena of blocks and only need to live
+   until their tag is written. The blocks are kept and reused for the next
+   tag, so after the first few tags nothing is allocated. */
+#define SVG_BLOCK_SIZE (1 << 16)
+typedef struct svg_block {
+  struct svg_block *next;
+  size_t size, used;
+  char data[];
+} svg_block;
+static __thread svg_block *svg_arena = NULL, *svg_arena_current = NULL;
+
+
+static FILE* svg_out(void){
+  return (svg_output != NULL)?svg_output:stdout;
+}
+
+void svg_set_output(FILE *out){
+  svg_output = out;
+}
+
+void svg_flush(void){
+  if(svg_buffer_length > 0)
+    fwrite(svg_buffer, 1, svg_buffer_length, svg_out());
+  svg_buffer_length = 0;
+}
+
+void svg_release(void){
+  svg_block *block, *next;
+
+  free(svg_buffer);
+  svg_buffer = NULL;
+  svg_buffer_length = 0;
+  for(block = svg_arena; block != NULL; block = next){
+    next = block->next;
+    free(block);
+  }
+  svg_arena = svg_arena_current = NULL;
+}
+
+static int svg_buffer_ready(void){
+  if(svg_buffer == NULL)
+    svg_buffer = malloc(SVG_BUFFER_SIZE);
+  return svg_buffer != NULL;
+}
+
+static void svg_write(const char *s, size_t length){
+  if(!svg_buffer_ready()) return;
+  if(svg_buffer_length + length > SVG_BUFFER_SIZE){
+    svg_flush();
+    if(length > SVG_BUFFER_SIZE){
+      fwrite(s, 1, length, svg_out());
+      return;
+    }
+  }
+  memcpy(svg_buffer + svg_buffer_length, s, length);
+  svg_buffer_length += length;
+}
+
+void svg_printf(const char* fmt, ...){
+  int retval;
+  size_t space = SVG_BUFFER_SIZE - svg_buffer_length;
   va_list vl;
 
-  /* Use vsnprintf to get the length of value string before allocating memory*/
+  if(!svg_buffer_ready()) return;
+
+  /* Format straight into the buffer, flushing and retrying if it didn't fit */
   va_start(vl, fmt);
-  retval = vsnprintf(NULL, 0, fmt, vl);
+  retval = vsnprintf(svg_buffer + svg_buffer_length, space, fmt, vl);
   va_end(vl);
-  if(retval < 0) return NULL;
+  if(retval < 0) return;
+  if((size_t)retval < space){
+    svg_buffer_length += retval;
+    return;
+  }
+
+  svg_flush();
+  va_start(vl, fmt);
+  if(retval < SVG_BUFFER_SIZE)
+    svg_buffer_length = vsnprintf(svg_buffer, SVG_BUFFER_SIZE, fmt, vl);
+  else
+    vfprintf(svg_out(), fmt, vl);
+  va_end(vl);
+}
+
+/* Room for `length` bytes in the arena, adding a block if no block left in
+   the chain has enough */
+static svg_block* svg_arena_reserve(size_t length){
+  svg_block *block = svg_arena_current, *last = NULL;
+
+  for(; block != NULL; last = block, block = block->next)
+    if(block->size - block->used >= length)
+      return svg_arena_current = block;
 
-  /* Allocate enough memory for entire attribute string: 
-       ' $name="$value"'
+  block = malloc(sizeof(svg_block) + ((length > SVG_BLOCK_SIZE)?length:SVG_BLOCK_SIZE));
+  if(block == NULL) return NULL;
+  block->next = NULL;
+  block->size = (length > SVG_BLOCK_SIZE)?length:SVG_BLOCK_SIZE;
+  block->used = 0;
+  if(last == NULL) svg_arena = block;
+  else last->next = block;
+  return svg_arena_current = block;
+}
+
+static void svg_arena_reset(void){
+  svg_block *block;
+  for(block = svg_arena; block != NULL; block = block->next)
+    block->used = 0;
+  svg_arena_current = svg_arena;
+}
+
+
+char* svg_attr(const char* name, const char* fmt, ...){
+  char *attr;
+  int retval;
+  size_t name_length = strlen(name), length, space;
+  svg_block *block;
+  va_list vl;
+
+  /* Format ' $name="$value"' into the space left in the current block. If the
+     value doesn't fit, vsnprintf has told us its length, so reserve exactly
+     that and format it again.
        length($name) + length($value) + 4 literals [ =""] + null char
    */
-  length = retval + strlen(name) + 5;
-  attr = malloc(length);
-  if(attr == NULL) return NULL;
+  block = svg_arena_reserve(name_length + 5);
+  if(block == NULL) return NULL;
+  attr = block->data + block->used;
+  space = block->size - block->used;
 
+  attr[0] = ' ';
+  memcpy(attr + 1, name, name_length);
+  attr[name_length+1] = '=';
+  attr[name_length+2] = '"';
 
-  /* Print beginning of attribute: ' $name="' ; freeing memory if failed*/
-  retval = snprintf(attr, length-1, " %s=\"", name);
-  if(retval < 0){
-    free(attr);
-    return NULL;
-  }
-  cur_length = retval;
-
-  /* Print attribute value; freeing memory if failed*/
   va_start(vl, fmt);
-  retval = vsnprintf(attr + cur_length, length-cur_length-1, fmt, vl);
+  retval = vsnprintf(attr + name_length + 3, space - name_length - 4, fmt, vl);
   va_end(vl);
-  if(retval < 0){
-    free(attr);
-    return NULL;
+  if(retval < 0) return NULL;
+
+  length = name_length + retval + 5;
+  if(length > space){
+    block = svg_arena_reserve(length);
+    if(block == NULL) return NULL;
+    memcpy(block->data + block->used, attr, name_length + 3);
+    attr = block->data + block->used;
+    va_start(vl, fmt);
+    vsnprintf(attr + name_length + 3, retval + 1, fmt, vl);
+    va_end(vl);
   }
-  cur_length += retval;
 
   /* Close quote and terminate string */
-  attr[cur_length] = '"';
-  attr[cur_length+1] = '\0';
-  
+  attr[length-2] = '"';
+  attr[length-1] = '\0';
+  block->used += length;
+
   return attr;
 }
 
@@ -63,29 +185,31 @@ void _svg_tag(const int simple, const char* type, int num, ...){
 
   /* Indent current tag */
   for( i = 0; i < _svg_indent_level; i++)
-    printf(INDENT);
+    svg_write(INDENT, sizeof(INDENT) - 1);
 
   /* Increase indent level if started tag with internal elements */
   if(!simple)
     _svg_indent_level++;
 
   /* Open tag */
-  printf("<%s", type);
+  svg_write("<", 1);
+  svg_write(type, strlen(type));
 
-  /* Print each attribute, free memory as used */
+  /* Copy each attribute, the arena is reused once the tag is written */
   va_start(vl, num);
   for(i = 0; i < num; i++){
     attr = va_arg(vl, char*);
-    printf("%s", attr);
-    free(attr);
+    if(attr != NULL)
+      svg_write(attr, strlen(attr));
   }
   va_end(vl);
+  svg_arena_reset();
 
   /* print nested closing tag if no internal elements expected */
-  if(simple) printf("/");
+  if(simple) svg_write("/", 1);
 
   /* close tag */
-  printf(">\n");
+  svg_write(">\n", 2);
 }
 
 
@@ -96,9 +220,46 @@ void svg_end_tag(const char* type){
     _svg_indent_level--;
 
   for( i = 0; i < _svg_indent_level; i++)
-    printf(INDENT);
+    svg_write(INDENT, sizeof(INDENT) - 1);
+
+  svg_write("</", 2);
+  svg_write(type, strlen(type));
+  svg_write(">\n", 2);
+}
+
+
+void svg_string_printf(svg_string *str, const char* fmt, ...){
+  int retval;
+  va_list vl;
+
+  if(str->capacity == 0){
+    str->capacity = 256;
+    str->s = malloc(str->capacity);
+  }
+
+  /* Format into the space left, growing and formatting again if it didn't
+     fit */
+  va_start(vl, fmt);
+  retval = vsnprintf(str->s + str->length, str->capacity - str->length, fmt, vl);
+  va_end(vl);
+  if(retval < 0) return;
+
+  if(str->length + retval >= str->capacity){
+    size_t capacity = str->capacity;
+    while(str->length + retval >= capacity)
+      capacity *= 2;
+    str->s = realloc(str->s, capacity);
+    str->capacity = capacity;
+
+    va_start(vl, fmt);
+    vsnprintf(str->s + str->length, str->capacity - str->length, fmt, vl);
+    va_end(vl);
+  }
+  str->length += retval;
+}
 
-  
-  printf("</%s>\n", type);
-  
+void svg_string_free(svg_string *str){
+  free(str->s);
+  str->s = NULL;
+  str->length = str->capacity = 0;
 }
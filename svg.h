@@ -1,10 +1,14 @@
 #ifndef __SVG_H
 #define __SVG_H
 
+#include <stddef.h>
+#include <stdio.h>
+
 /* Add an attribute to the svg tag. 
      - `name` = name of attribute. 
      - `fmt`  = printf format
      - `...`  = are variables passed to printf
+   The string lives until the next tag is printed.
  */
 /* #define svg_attr(name, type, ...) " " #name "=" #type , __VA_ARGS__ */
 char* svg_attr(const char* name, const char* fmt, ...);
@@ -25,5 +29,34 @@ void _svg_tag(const int simple, const char* type, int num, ...);
  */
 void svg_end_tag(const char* type);
 
+/* Print text between tags, printf style. Output is buffered, so anything
+   meant to go between tags must be printed with this rather than printf */
+void svg_printf(const char* fmt, ...);
+
+/* Write out everything buffered so far. Must be called before exiting */
+void svg_flush(void);
+
+/* Send output to `out` from now on, stdout by default. Flush first. Each
+   thread has a writer of its own, with its own output, so threads can draw
+   at the same time. */
+void svg_set_output(FILE *out);
+
+/* Free the calling thread's buffers, after svg_flush. They are allocated
+   again if it draws more. */
+void svg_release(void);
+
+/* Growable string for long attribute values, such as the points of a
+   polyline. Starts empty when zeroed, e.g. `svg_string points = {0};` */
+typedef struct {
+  char *s;
+  size_t length, capacity;
+} svg_string;
+
+/* Append to `str`, printf style. Grows by doubling, so building a string of
+   n pieces takes O(n) */
+void svg_string_printf(svg_string *str, const char* fmt, ...);
+
+void svg_string_free(svg_string *str);
+
 
 #endif
@@ -0,0 +1,585 @@
+#include "tally.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TALLY_X86 1
+#include <immintrin.h>
+#endif
+
+#define likely(x)   __builtin_expect ((x), 1)
+#define unlikely(x) __builtin_expect ((x), 0)
+
+/* Flushing before this many bumps of any one counter keeps them from
+   wrapping */
+#ifndef TALLY_FLUSH_READS
+#define TALLY_FLUSH_READS UINT32_MAX
+#endif
+
+
+void tally_init(read_tally *tally) {
+    memset(tally, 0, sizeof(read_tally));
+}
+
+/* Size the per-adapter counters to `adapters` per position, over the whole
+   capacity */
+static void grow_adapter_hits(read_tally *tally, uint64_t old_capacity, int adapters) {
+    tally->adapter_hits = realloc(tally->adapter_hits, tally->capacity*adapters*sizeof(uint64_t));
+    memset(tally->adapter_hits + old_capacity*adapters, 0,
+           (tally->capacity - old_capacity)*adapters*sizeof(uint64_t));
+    tally->adapters = adapters;
+}
+
+/* Grow every plane to at least `length` positions. Capacity doubles so reads
+   that get slightly longer don't reallocate each time. */
+static void grow_positions(read_tally *tally, uint64_t length) {
+    uint64_t old_capacity, capacity = (tally->capacity > 0)?tally->capacity:64;
+
+    while (capacity < length)
+        capacity *= 2;
+
+    tally->content = realloc(tally->content, 4*capacity*sizeof(uint32_t));
+    memset(tally->content + 4*tally->capacity, 0, 4*(capacity - tally->capacity)*sizeof(uint32_t));
+
+    tally->scores = realloc(tally->scores, capacity*tally->score_width*sizeof(uint32_t));
+    memset(tally->scores + tally->capacity*tally->score_width, 0,
+           (capacity - tally->capacity)*tally->score_width*sizeof(uint32_t));
+
+    tally->length_count = realloc(tally->length_count, capacity*sizeof(uint32_t));
+    memset(tally->length_count + tally->capacity, 0, (capacity - tally->capacity)*sizeof(uint32_t));
+    tally->kmer_count = realloc(tally->kmer_count, capacity*sizeof(uint32_t));
+    memset(tally->kmer_count + tally->capacity, 0, (capacity - tally->capacity)*sizeof(uint32_t));
+
+    old_capacity = tally->capacity;
+    tally->capacity = capacity;
+    if (tally->adapters > 0)
+        grow_adapter_hits(tally, old_capacity, tally->adapters);
+}
+
+/* Extend the quality rows to cover the characters `low` to `high` */
+static void widen_scores(read_tally *tally, int low, int high) {
+    int width, shift, j;
+    uint64_t i;
+    uint32_t *scores;
+
+    if (tally->score_width > 0) {
+        if (tally->score_min < low)
+            low = tally->score_min;
+        if (tally->score_min + tally->score_width - 1 > high)
+            high = tally->score_min + tally->score_width - 1;
+    }
+    width = high - low + 1;
+    shift = tally->score_min - low;
+
+    scores = calloc(tally->capacity*width, sizeof(uint32_t));
+    for (i = 0; i < tally->max_length; i++)
+        for (j = 0; j < tally->score_width; j++)
+            scores[i*width + shift + j] = tally->scores[i*tally->score_width + j];
+    free(tally->scores);
+
+    tally->scores = scores;
+    tally->score_min = low;
+    tally->score_width = width;
+}
+
+/*************** Kernels ***************/
+
+/* Reads are counted in blocks of up to 64 bases. A kernel converts a block of
+   bases to content indexes (`base_code`) and quality characters to score row columns; the
+   counters are then bumped from those two small arrays. It also adds up the
+   G and C bases and the columns of the block, for the per read histograms. The x86 kernels do the
+   conversion 16, 32 or 64 bytes at a time and are picked at startup from what
+   the CPU supports. QUACK_KERNEL=scalar|sse4.2|avx2|avx512 forces one. */
+#define KERNEL_BLOCK 64
+
+typedef struct {
+    const char *name;
+    /* Smallest and largest quality character in `qual` */
+    void (*range)(const unsigned char *qual, uint64_t length, unsigned char *low, unsigned char *high);
+    /* Fill `codes` and `columns` for `n` <= KERNEL_BLOCK bases, and add
+       the G and C bases to `gc` and the columns to `quality` */
+    void (*classify)(const unsigned char *seq, const unsigned char *qual, int n, int score_min,
+                     unsigned char *codes, unsigned char *columns, uint64_t *gc, uint64_t *quality);
+} tally_kernel;
+
+static void range_scalar(const unsigned char *qual, uint64_t length, unsigned char *low, unsigned char *high) {
+    unsigned char lo = *low, hi = *high;
+    uint64_t i;
+    for (i = 0; i < length; i++) {
+        lo = (qual[i] < lo)?qual[i]:lo;
+        hi = (qual[i] > hi)?qual[i]:hi;
+    }
+    *low = lo;
+    *high = hi;
+}
+
+static void classify_scalar(const unsigned char *seq, const unsigned char *qual, int n, int score_min,
+                            unsigned char *codes, unsigned char *columns, uint64_t *gc, uint64_t *quality) {
+    uint32_t g = 0, q = 0;
+    unsigned char code, column;
+    int j;
+    for (j = 0; j < n; j++) {
+        code = base_code[seq[j]];
+        column = qual[j] - score_min;
+        codes[j] = code;
+        columns[j] = column;
+        /* C and G are codes 2 and 3 */
+        g += code >> 1;
+        q += column;
+    }
+    *gc += g;
+    *quality += q;
+}
+
+#ifdef TALLY_X86
+
+__attribute__((target("sse4.2")))
+static void range_sse42(const unsigned char *qual, uint64_t length, unsigned char *low, unsigned char *high) {
+    __m128i lo = _mm_set1_epi8(-1), hi = _mm_setzero_si128();
+    uint64_t i;
+
+    for (i = 0; i + 16 <= length; i += 16) {
+        __m128i q = _mm_loadu_si128((const __m128i*)(qual + i));
+        lo = _mm_min_epu8(lo, q);
+        hi = _mm_max_epu8(hi, q);
+    }
+    /* Fold the 16 lanes down to one */
+    lo = _mm_min_epu8(lo, _mm_srli_si128(lo, 8));
+    lo = _mm_min_epu8(lo, _mm_srli_si128(lo, 4));
+    lo = _mm_min_epu8(lo, _mm_srli_si128(lo, 2));
+    lo = _mm_min_epu8(lo, _mm_srli_si128(lo, 1));
+    hi = _mm_max_epu8(hi, _mm_srli_si128(hi, 8));
+    hi = _mm_max_epu8(hi, _mm_srli_si128(hi, 4));
+    hi = _mm_max_epu8(hi, _mm_srli_si128(hi, 2));
+    hi = _mm_max_epu8(hi, _mm_srli_si128(hi, 1));
+    if ((unsigned char)_mm_extract_epi8(lo, 0) < *low) *low = _mm_extract_epi8(lo, 0);
+    if ((unsigned char)_mm_extract_epi8(hi, 0) > *high) *high = _mm_extract_epi8(hi, 0);
+
+    range_scalar(qual + i, length - i, low, high);
+}
+
+__attribute__((target("sse4.2,popcnt")))
+static void classify_sse42(const unsigned char *seq, const unsigned char *qual, int n, int score_min,
+                           unsigned char *codes, unsigned char *columns, uint64_t *gc, uint64_t *quality) {
+    const __m128i upper = _mm_set1_epi8(~0x20);
+    const __m128i t = _mm_set1_epi8('T'), c = _mm_set1_epi8('C'), g = _mm_set1_epi8('G');
+    const __m128i one = _mm_set1_epi8(1), two = _mm_set1_epi8(2), three = _mm_set1_epi8(3);
+    const __m128i offset = _mm_set1_epi8(score_min);
+    __m128i sum = _mm_setzero_si128();
+    uint32_t count = 0;
+    int j;
+
+    for (j = 0; j + 16 <= n; j += 16) {
+        __m128i b = _mm_and_si128(_mm_loadu_si128((const __m128i*)(seq + j)), upper);
+        __m128i is_c = _mm_cmpeq_epi8(b, c), is_g = _mm_cmpeq_epi8(b, g);
+        __m128i code = _mm_or_si128(_mm_and_si128(_mm_cmpeq_epi8(b, t), one),
+                                    _mm_or_si128(_mm_and_si128(is_c, two), _mm_and_si128(is_g, three)));
+        __m128i column = _mm_sub_epi8(_mm_loadu_si128((const __m128i*)(qual + j)), offset);
+        _mm_storeu_si128((__m128i*)(codes + j), code);
+        _mm_storeu_si128((__m128i*)(columns + j), column);
+        count += __builtin_popcount(_mm_movemask_epi8(_mm_or_si128(is_c, is_g)));
+        /* Sums of absolute differences from 0 add up each half */
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(column, _mm_setzero_si128()));
+    }
+    /* A block's columns add up to well under 2^32 */
+    *gc += count;
+    *quality += (uint32_t)_mm_cvtsi128_si32(_mm_add_epi64(sum, _mm_unpackhi_epi64(sum, sum)));
+    classify_scalar(seq + j, qual + j, n - j, score_min, codes + j, columns + j, gc, quality);
+}
+
+__attribute__((target("avx2")))
+static void range_avx2(const unsigned char *qual, uint64_t length, unsigned char *low, unsigned char *high) {
+    __m256i lo = _mm256_set1_epi8(-1), hi = _mm256_setzero_si256();
+    __m128i lo128, hi128;
+    uint64_t i;
+
+    for (i = 0; i + 32 <= length; i += 32) {
+        __m256i q = _mm256_loadu_si256((const __m256i*)(qual + i));
+        lo = _mm256_min_epu8(lo, q);
+        hi = _mm256_max_epu8(hi, q);
+    }
+    lo128 = _mm_min_epu8(_mm256_castsi256_si128(lo), _mm256_extracti128_si256(lo, 1));
+    hi128 = _mm_max_epu8(_mm256_castsi256_si128(hi), _mm256_extracti128_si256(hi, 1));
+    lo128 = _mm_min_epu8(lo128, _mm_srli_si128(lo128, 8));
+    lo128 = _mm_min_epu8(lo128, _mm_srli_si128(lo128, 4));
+    lo128 = _mm_min_epu8(lo128, _mm_srli_si128(lo128, 2));
+    lo128 = _mm_min_epu8(lo128, _mm_srli_si128(lo128, 1));
+    hi128 = _mm_max_epu8(hi128, _mm_srli_si128(hi128, 8));
+    hi128 = _mm_max_epu8(hi128, _mm_srli_si128(hi128, 4));
+    hi128 = _mm_max_epu8(hi128, _mm_srli_si128(hi128, 2));
+    hi128 = _mm_max_epu8(hi128, _mm_srli_si128(hi128, 1));
+    if ((unsigned char)_mm_extract_epi8(lo128, 0) < *low) *low = _mm_extract_epi8(lo128, 0);
+    if ((unsigned char)_mm_extract_epi8(hi128, 0) > *high) *high = _mm_extract_epi8(hi128, 0);
+
+    range_scalar(qual + i, length - i, low, high);
+}
+
+__attribute__((target("avx2,popcnt")))
+static void classify_avx2(const unsigned char *seq, const unsigned char *qual, int n, int score_min,
+                          unsigned char *codes, unsigned char *columns, uint64_t *gc, uint64_t *quality) {
+    const __m256i upper = _mm256_set1_epi8(~0x20);
+    const __m256i t = _mm256_set1_epi8('T'), c = _mm256_set1_epi8('C'), g = _mm256_set1_epi8('G');
+    const __m256i one = _mm256_set1_epi8(1), two = _mm256_set1_epi8(2), three = _mm256_set1_epi8(3);
+    const __m256i offset = _mm256_set1_epi8(score_min);
+    __m256i sum = _mm256_setzero_si256();
+    __m128i sum128;
+    uint32_t count = 0;
+    int j;
+
+    for (j = 0; j + 32 <= n; j += 32) {
+        __m256i b = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(seq + j)), upper);
+        __m256i is_c = _mm256_cmpeq_epi8(b, c), is_g = _mm256_cmpeq_epi8(b, g);
+        __m256i code = _mm256_or_si256(_mm256_and_si256(_mm256_cmpeq_epi8(b, t), one),
+                                       _mm256_or_si256(_mm256_and_si256(is_c, two),
+                                                       _mm256_and_si256(is_g, three)));
+        __m256i column = _mm256_sub_epi8(_mm256_loadu_si256((const __m256i*)(qual + j)), offset);
+        _mm256_storeu_si256((__m256i*)(codes + j), code);
+        _mm256_storeu_si256((__m256i*)(columns + j), column);
+        count += __builtin_popcount(_mm256_movemask_epi8(_mm256_or_si256(is_c, is_g)));
+        sum = _mm256_add_epi64(sum, _mm256_sad_epu8(column, _mm256_setzero_si256()));
+    }
+    sum128 = _mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    *gc += count;
+    *quality += (uint32_t)_mm_cvtsi128_si32(_mm_add_epi64(sum128, _mm_unpackhi_epi64(sum128, sum128)));
+    /* The tail is handled by non-VEX code; clear the upper halves first or
+       every SSE instruction in it pays a transition penalty */
+    _mm256_zeroupper();
+    classify_sse42(seq + j, qual + j, n - j, score_min, codes + j, columns + j, gc, quality);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void range_avx512(const unsigned char *qual, uint64_t length, unsigned char *low, unsigned char *high) {
+    __m512i lo = _mm512_set1_epi8(-1), hi = _mm512_setzero_si512();
+    uint64_t i;
+
+    for (i = 0; i + 64 <= length; i += 64) {
+        __m512i q = _mm512_loadu_si512((const void*)(qual + i));
+        lo = _mm512_min_epu8(lo, q);
+        hi = _mm512_max_epu8(hi, q);
+    }
+    /* Any tail of up to 63 bytes is loaded under a mask; masked-off lanes
+       don't disturb the min or max */
+    if (i < length) {
+        __mmask64 tail = (1ULL << (length - i)) - 1;
+        lo = _mm512_min_epu8(lo, _mm512_mask_loadu_epi8(_mm512_set1_epi8(-1), tail, qual + i));
+        hi = _mm512_max_epu8(hi, _mm512_maskz_loadu_epi8(tail, qual + i));
+    }
+    {
+        unsigned char l[64], h[64];
+        _mm512_storeu_si512((void*)l, lo);
+        _mm512_storeu_si512((void*)h, hi);
+        _mm256_zeroupper();
+        range_scalar(l, 64, low, &(unsigned char){0});
+        range_scalar(h, 64, &(unsigned char){255}, high);
+    }
+}
+
+__attribute__((target("avx512f,avx512bw,popcnt")))
+static void classify_avx512(const unsigned char *seq, const unsigned char *qual, int n, int score_min,
+                            unsigned char *codes, unsigned char *columns, uint64_t *gc, uint64_t *quality) {
+    const __m512i upper = _mm512_set1_epi8(~0x20);
+    const __m512i t = _mm512_set1_epi8('T'), c = _mm512_set1_epi8('C'), g = _mm512_set1_epi8('G');
+    const __m512i one = _mm512_set1_epi8(1), two = _mm512_set1_epi8(2), three = _mm512_set1_epi8(3);
+    const __m512i offset = _mm512_set1_epi8(score_min);
+    __mmask64 valid = (n == 64)?~0ULL:(1ULL << n) - 1;
+    __mmask64 is_c, is_g;
+    __m512i b, code, column;
+
+    /* A whole block is one (masked) 64 byte vector. Masked-off bases load as
+       0, which is neither C nor G, and their columns are kept at 0. */
+    b = _mm512_and_si512(_mm512_maskz_loadu_epi8(valid, seq), upper);
+    is_c = _mm512_cmpeq_epi8_mask(b, c);
+    is_g = _mm512_cmpeq_epi8_mask(b, g);
+    code = _mm512_maskz_mov_epi8(_mm512_cmpeq_epi8_mask(b, t), one);
+    code = _mm512_mask_mov_epi8(code, is_c, two);
+    code = _mm512_mask_mov_epi8(code, is_g, three);
+    column = _mm512_maskz_sub_epi8(valid, _mm512_maskz_loadu_epi8(valid, qual), offset);
+    _mm512_mask_storeu_epi8(codes, valid, code);
+    _mm512_mask_storeu_epi8(columns, valid, column);
+    *gc += __builtin_popcountll(is_c | is_g);
+    *quality += _mm512_reduce_add_epi64(_mm512_sad_epu8(column, _mm512_setzero_si512()));
+}
+
+#endif
+
+static const tally_kernel kernels[] = {
+#ifdef TALLY_X86
+    {"avx512", range_avx512, classify_avx512},
+    {"avx2",   range_avx2,   classify_avx2},
+    {"sse4.2", range_sse42,  classify_sse42},
+#endif
+    {"scalar", range_scalar, classify_scalar}
+};
+static const tally_kernel *kernel = &kernels[sizeof(kernels)/sizeof(kernels[0]) - 1];
+
+static int kernel_supported(const tally_kernel *k) {
+#ifdef TALLY_X86
+    if (strcmp(k->name, "avx512") == 0)
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+    if (strcmp(k->name, "avx2") == 0)
+        return __builtin_cpu_supports("avx2");
+    if (strcmp(k->name, "sse4.2") == 0)
+        return __builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt");
+#endif
+    return 1;
+}
+
+/* Pick the widest supported kernel before main() runs, so worker threads only
+   ever read `kernel` */
+__attribute__((constructor))
+static void select_kernel(void) {
+    const char *forced = getenv("QUACK_KERNEL");
+    int i;
+
+#ifdef TALLY_X86
+    __builtin_cpu_init();
+#endif
+    for (i = 0; i < sizeof(kernels)/sizeof(kernels[0]); i++) {
+        if (!kernel_supported(&kernels[i]))
+            continue;
+        if (forced == NULL || strcmp(forced, kernels[i].name) == 0) {
+            kernel = &kernels[i];
+            break;
+        }
+    }
+}
+
+const char* tally_kernel_name(void) {
+    return kernel->name;
+}
+
+/* Count positions `start` to `end` of a read, all past TALLY_EXACT, into their
+   bins, adding to `gc` and `quality` as the kernel does */
+static void tally_binned(read_tally *tally, const char *seq, const char *qual,
+                         uint64_t start, uint64_t end, uint64_t *gc, uint64_t *quality) {
+    uint64_t i, bin, bin_end;
+    unsigned char codes[KERNEL_BLOCK], columns[KERNEL_BLOCK];
+
+    for (bin = tally_bin(start); start < end; bin++, start = bin_end) {
+        uint32_t *content = tally->content + 4*bin;
+        uint32_t *row = tally->scores + bin*tally->score_width;
+
+        bin_end = tally_bin_start(bin + 1);
+        if (bin_end > end)
+            bin_end = end;
+        for (i = start; i < bin_end; i += KERNEL_BLOCK) {
+            int j, n = (bin_end - i < KERNEL_BLOCK)?bin_end - i:KERNEL_BLOCK;
+
+            kernel->classify((const unsigned char*)seq + i, (const unsigned char*)qual + i, n,
+                             tally->score_min, codes, columns, gc, quality);
+            for (j = 0; j < n; j++) {
+                content[codes[j]]++;
+                row[columns[j]]++;
+            }
+        }
+    }
+}
+
+/* Count one read. Always inlined, so that the copies for fixed lengths below
+   have their loops unrolled and their divisions done by multiplying. */
+__attribute__((always_inline))
+static inline void count_read(read_tally *tally, const char *seq, const char *qual, uint64_t length,
+                              const kmer_index *adapters) {
+    uint64_t i, bins = length, weight = 1, exact = length, hash, gc = 0, quality = 0;
+    uint32_t *content, *row;
+    int score_min, score_width, mean;
+    unsigned char low = 255, high = 0;
+    unsigned char codes[KERNEL_BLOCK], columns[KERNEL_BLOCK];
+
+    if (unlikely(length > TALLY_EXACT)) {
+        bins = tally_bin(length - 1) + 1;
+        weight = tally_bin_start(bins) - tally_bin_start(bins - 1);
+        exact = TALLY_EXACT;
+    }
+    if (unlikely(tally->reads > TALLY_FLUSH_READS - weight))
+        tally_flush(tally);
+    tally->reads += weight;
+    tally->number_of_sequences++;
+    tally->total_bases += length;
+
+    if (unlikely(bins > tally->capacity))
+        grow_positions(tally, bins);
+    if (unlikely(bins > tally->max_length))
+        tally->max_length = bins;
+    hash = duplication_hash(seq, length);
+    duplication_add(&tally->duplication, hash);
+    if (!tally->ordered)
+        overrepresented_add(&tally->overrepresented, hash, seq, length);
+    tally->last_hash = hash;
+    if (unlikely(length == 0))
+        return;
+
+    /* Range check the whole read up front so the counting loop is branch
+       free */
+    kernel->range((const unsigned char*)qual, length, &low, &high);
+    if (unlikely(low < tally->score_min || high >= tally->score_min + tally->score_width))
+        widen_scores(tally, low, high);
+
+    content = tally->content;
+    row = tally->scores;
+    score_min = tally->score_min;
+    score_width = tally->score_width;
+#pragma GCC unroll 4
+    for (i = 0; i < exact; i += KERNEL_BLOCK) {
+        int j, n = (exact - i < KERNEL_BLOCK)?exact - i:KERNEL_BLOCK;
+        uint32_t *position = content + 4*i;
+
+        kernel->classify((const unsigned char*)seq + i, (const unsigned char*)qual + i, n, score_min,
+                         codes, columns, &gc, &quality);
+#pragma GCC unroll 64
+        for (j = 0; j < n; j++, position += 4, row += score_width) {
+            position[codes[j]]++;
+            row[columns[j]]++;
+        }
+    }
+    if (unlikely(length > exact))
+        tally_binned(tally, seq, qual, exact, length, &gc, &quality);
+
+    /* Rounded to the nearest percent and quality character */
+    tally->gc[(100*gc + length/2)/length]++;
+    mean = score_min + (quality + length/2)/length - 33;
+    tally->mean_quality[(mean < 0)?0:(mean > 90)?90:mean]++;
+
+    /* Position of the first adapter k-mer, and which adapter it belongs to */
+    if (adapters) {
+        i = kmer_index_scan(adapters, seq, length);
+        /* One lookup for each k-mer up to the one ending at i */
+        if (length > (uint64_t)adapters->kmer_size)
+            tally->adapter_probes += i - adapters->kmer_size + 1;
+        if (i < length) {
+            tally->adapter_reads++;
+            int adapter = kmer_index_attribute(adapters, seq, length, i);
+            i = tally_bin(i);
+            tally->kmer_count[i]++;
+            if (unlikely(tally->adapters == 0))
+                grow_adapter_hits(tally, 0, adapters->adapters);
+            tally->adapter_hits[i*tally->adapters + adapter]++;
+        }
+    }
+
+    tally->length_count[bins-1]++;
+}
+
+/* Copies of count_read for the read lengths of common short read runs,
+   where the blocks and bases of a read are a fixed number */
+#define FIXED_LENGTH(n)                                                          \
+    static void count_##n(read_tally *tally, const char *seq, const char *qual, \
+                          const kmer_index *adapters) {                         \
+        count_read(tally, seq, qual, n, adapters);                              \
+    }
+FIXED_LENGTH(50)
+FIXED_LENGTH(75)
+FIXED_LENGTH(100)
+FIXED_LENGTH(150)
+FIXED_LENGTH(250)
+
+static const struct {
+    uint64_t length;
+    void (*count)(read_tally *tally, const char *seq, const char *qual, const kmer_index *adapters);
+} fixed_lengths[] = {
+    {50, count_50}, {75, count_75}, {100, count_100}, {150, count_150}, {250, count_250}
+};
+
+void tally_read(read_tally *tally, const char *seq, const char *qual, uint64_t length,
+                const kmer_index *adapters) {
+    int i;
+
+    if (likely(length == tally->fixed_length && length != 0)) {
+        fixed_lengths[tally->fixed].count(tally, seq, qual, adapters);
+        return;
+    }
+    /* Files mostly have one read length, so the first of these lengths seen
+       is taken to be it. Reads of any other length are still counted, just
+       by the general code. */
+    if (tally->fixed_length == 0) {
+        for (i = 0; i < sizeof(fixed_lengths)/sizeof(fixed_lengths[0]); i++) {
+            if (fixed_lengths[i].length == length) {
+                tally->fixed_length = length;
+                tally->fixed = i;
+                break;
+            }
+        }
+    }
+    count_read(tally, seq, qual, length, adapters);
+}
+
+void tally_flush(read_tally *tally) {
+    uint64_t i, capacity = tally->capacity;
+    int j, score;
+    base_information *base;
+
+    if (tally->max_length > tally->bases_length) {
+        tally->bases = realloc(tally->bases, tally->max_length*sizeof(base_information));
+        memset(tally->bases + tally->bases_length, 0,
+               (tally->max_length - tally->bases_length)*sizeof(base_information));
+        tally->bases_length = tally->max_length;
+    }
+
+    for (i = 0; i < tally->max_length; i++) {
+        base = &tally->bases[i];
+        for (j = 0; j < 4; j++)
+            base->content[j] += tally->content[4*i + j];
+        /* Quality characters outside '!' to '{' are kept in the end columns */
+        for (j = 0; j < tally->score_width; j++) {
+            score = tally->score_min + j - 33;
+            if (score < 0) score = 0;
+            if (score > 90) score = 90;
+            base->scores[score] += tally->scores[i*tally->score_width + j];
+        }
+        base->length_count += tally->length_count[i];
+        base->kmer_count += tally->kmer_count[i];
+    }
+
+    if (capacity > 0) {
+        memset(tally->content, 0, 4*capacity*sizeof(uint32_t));
+        memset(tally->scores, 0, capacity*tally->score_width*sizeof(uint32_t));
+        memset(tally->length_count, 0, capacity*sizeof(uint32_t));
+        memset(tally->kmer_count, 0, capacity*sizeof(uint32_t));
+    }
+    tally->reads = 0;
+}
+
+void tally_merge(read_tally *to, read_tally *from) {
+    uint64_t i;
+    int j;
+
+    tally_flush(from);
+    if (from->max_length > to->capacity)
+        grow_positions(to, from->max_length);
+    if (from->adapters > 0 && to->adapters == 0)
+        grow_adapter_hits(to, 0, from->adapters);
+    for (i = 0; i < from->max_length*from->adapters; i++)
+        to->adapter_hits[i] += from->adapter_hits[i];
+    if (from->max_length > to->max_length)
+        to->max_length = from->max_length;
+    tally_flush(to);
+
+    for (i = 0; i < from->max_length; i++) {
+        for (j = 0; j < 91; j++)
+            to->bases[i].scores[j] += from->bases[i].scores[j];
+        for (j = 0; j < 4; j++)
+            to->bases[i].content[j] += from->bases[i].content[j];
+        to->bases[i].length_count += from->bases[i].length_count;
+        to->bases[i].kmer_count += from->bases[i].kmer_count;
+    }
+    to->number_of_sequences += from->number_of_sequences;
+    to->total_bases += from->total_bases;
+    to->adapter_probes += from->adapter_probes;
+    to->adapter_reads += from->adapter_reads;
+    for (j = 0; j < TALLY_GC_BINS; j++)
+        to->gc[j] += from->gc[j];
+    for (j = 0; j < 91; j++)
+        to->mean_quality[j] += from->mean_quality[j];
+    duplication_merge(&to->duplication, &from->duplication);
+    overrepresented_merge(&to->overrepresented, &from->overrepresented);
+}
+
+void tally_free(read_tally *tally) {
+    free(tally->content);
+    free(tally->scores);
+    free(tally->length_count);
+    free(tally->kmer_count);
+    tally->content = tally->scores = tally->length_count = tally->kmer_count = NULL;
+    tally->capacity = 0;
+}
@@ -0,0 +1,139 @@
+#ifndef __TALLY_H
+#define __TALLY_H
+
+#include <stdint.h>
+
+#include "duplication.h"
+#include "kmer.h"
+#include "overrepresented.h"
+
+/* Positions are counted one by one below TALLY_EXACT. Past that, each
+   doubling of the position is split into TALLY_OCTAVE_BINS equal bins, so
+   even the longest reads need only a few thousand counters. Both are powers
+   of 2, given here by their log. */
+#define TALLY_EXACT_BITS  12
+#define TALLY_OCTAVE_BITS 9
+#define TALLY_EXACT       (1 << TALLY_EXACT_BITS)
+#define TALLY_OCTAVE_BINS (1 << TALLY_OCTAVE_BITS)
+
+/* Bin holding the 0 based `position` */
+static inline uint64_t tally_bin(uint64_t position) {
+    int octave;
+
+    if (position < TALLY_EXACT)
+        return position;
+    octave = 63 - __builtin_clzll(position) - TALLY_EXACT_BITS;
+    return TALLY_EXACT + ((uint64_t)octave << TALLY_OCTAVE_BITS)
+        + ((position - ((uint64_t)TALLY_EXACT << octave)) >> (octave + TALLY_EXACT_BITS - TALLY_OCTAVE_BITS));
+}
+
+/* First 0 based position of `bin`; for one past the last bin, the length
+   covered by all of them */
+static inline uint64_t tally_bin_start(uint64_t bin) {
+    int octave;
+
+    if (bin < TALLY_EXACT)
+        return bin;
+    octave = (bin - TALLY_EXACT) >> TALLY_OCTAVE_BITS;
+    return ((uint64_t)TALLY_EXACT << octave)
+        + (((bin - TALLY_EXACT) & (TALLY_OCTAVE_BINS - 1)) << (octave + TALLY_EXACT_BITS - TALLY_OCTAVE_BITS));
+}
+
+/* Reads are also counted by their percentage of G and C bases, 0 to 100 */
+#define TALLY_GC_BINS 101
+
+/* Totals for one read position, or one bin of positions */
+typedef struct {
+    uint64_t scores[91];
+    uint64_t content[4];
+    uint64_t length_count;
+    uint64_t kmer_count;
+} base_information;
+
+/* Per-thread read accumulator.
+
+   Counting is done in 32-bit planes indexed by bin (see tally_bin), so a read
+   walks two dense arrays instead of one 776 byte struct per base:
+     - `content` = 4 counters (A, T, C, G) per bin
+     - `scores`  = one row of `score_width` counters per bin, covering only
+                   the quality characters seen so far, starting at
+                   `score_min`
+   A read bumps each counter at most once per position in its bin, so
+   `reads` adds up the widest bin each read reaches and the planes are added
+   to the 64-bit `bases` totals and cleared before it can overflow.
+   `max_length` is the number of bins used, the longest read for reads of
+   up to TALLY_EXACT bases.
+
+   `adapter_hits` holds `adapters` 64-bit counters per bin, one for each
+   adapter, counting reads where that adapter was found. At most one adapter is
+   found per read, so these are counted directly and never flushed.
+
+   `gc` counts reads by the percentage of their bases that are G or C, and
+   `mean_quality` by their mean quality character, rounded, with the same
+   columns as `scores` in base_information. Both are 64-bit and counted
+   directly.
+
+   `duplication` estimates how many reads are duplicates (see
+   duplication.h), and `overrepresented` follows the most common sequences
+   (see overrepresented.h). With `ordered` set, reads are not added to
+   `overrepresented`: the caller adds them itself, in file order, taking each
+   read's duplication hash from `last_hash` after counting it.
+
+   `fixed_length` is the read length, if any, that tally_read counts with
+   code specialised for it, and `fixed` which copy that is.
+
+   `total_bases`, `adapter_probes` (k-mers looked up) and `adapter_reads`
+   (reads an adapter was found in) are only reported by `--profile`.
+ */
+typedef struct {
+    uint32_t *content;
+    uint32_t *scores;
+    uint32_t *length_count;
+    uint32_t *kmer_count;
+    uint64_t capacity;
+    int score_min, score_width;
+    uint32_t reads;
+
+    uint64_t *adapter_hits;
+    int adapters;
+
+    base_information *bases;
+    uint64_t bases_length;
+    uint64_t max_length;
+    uint64_t number_of_sequences;
+    uint64_t fixed_length;
+    int fixed;
+    uint64_t total_bases, adapter_probes, adapter_reads;
+    uint64_t gc[TALLY_GC_BINS];
+    uint64_t mean_quality[91];
+
+    duplication_sketch duplication;
+    overrepresented_summary overrepresented;
+    int ordered;
+    uint64_t last_hash;
+} read_tally;
+
+/* Initialise an empty tally */
+void tally_init(read_tally *tally);
+
+/* Count one read.
+     - `seq`, `qual` = bases and quality characters, `length` long
+     - `adapters`    = adapter k-mers, NULL to skip the adapter scan
+ */
+void tally_read(read_tally *tally, const char *seq, const char *qual, uint64_t length,
+                const kmer_index *adapters);
+
+/* Add the 32-bit counters to the 64-bit totals in `bases` and clear them */
+void tally_flush(read_tally *tally);
+
+/* Flush both tallies and add the totals of `from` into `to` */
+void tally_merge(read_tally *to, read_tally *from);
+
+/* Name of the counting kernel picked for this CPU */
+const char* tally_kernel_name(void);
+
+/* Release the counting planes. `bases`, `adapter_hits`, `duplication` and
+   `overrepresented` are left for the caller to free. */
+void tally_free(read_tally *tally);
+
+#endif
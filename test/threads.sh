@@ -0,0 +1,58 @@
+#!/bin/sh
+# Threaded runs must report exactly what a single thread does, including the
+# overrepresented sequences, which depend on the order reads are counted in.
+# The reads are mostly distinct, far more of them than OVERREPRESENTED_COUNTERS,
+# with a few sequences repeated from part way through the file so they are
+# reported with an error. Both the mapped (plain) and stream (gzip) paths
+# are checked, the latter with one gzip member and with several, which are
+# inflated in pieces on different threads.
+#
+# Usage: threads.sh [QUACK]
+set -e
+quack=${1:-./quack}
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+awk 'BEGIN {
+    srand(11);
+    n = 200000;
+    split("A C G T", base, " ");
+    for (j = 0; j < 60; j++) {
+        top[j] = "";
+        for (k = 0; k < 50; k++)
+            top[j] = top[j] base[int(rand()*4) + 1];
+        from[j] = int(n/3 + rand()*n/2);
+    }
+    for (i = 0; i < n; i++) {
+        seq = "";
+        j = int(rand()*60);
+        if (from[j] <= i && rand() < 0.15)
+            seq = top[j];
+        else
+            for (k = 0; k < 50; k++)
+                seq = seq base[int(rand()*4) + 1];
+        printf "@r%d\n%s\n+\nIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIII\n", i, seq;
+    }
+}' > "$dir/reads.fq"
+gzip -c "$dir/reads.fq" > "$dir/reads.fq.gz"
+split -l 200000 "$dir/reads.fq" "$dir/part."
+for part in "$dir"/part.*; do
+    gzip -c "$part" >> "$dir/members.fq.gz"
+done
+
+for file in reads.fq reads.fq.gz members.fq.gz; do
+    "$quack" -u "$dir/$file" -f json -t 1 > "$dir/expected.json"
+    if ! grep -q '"error": [1-9]' "$dir/expected.json"; then
+        echo "threads.sh: no overrepresented sequence with an error in $file" >&2
+        exit 1
+    fi
+    for threads in 2 3 8; do
+        "$quack" -u "$dir/$file" -f json -t $threads > "$dir/got.json"
+        if ! cmp -s "$dir/expected.json" "$dir/got.json"; then
+            echo "threads.sh: -t $threads differs from -t 1 on $file" >&2
+            diff "$dir/expected.json" "$dir/got.json" | head -20 >&2
+            exit 1
+        fi
+    done
+done
+echo "threads.sh: ok"